@@ -0,0 +1,262 @@
+// vim: set expandtab shiftwidth=4 tabstop=4:
+
+/*
+ *  bench/fermat_bench.cpp
+ *
+ *  Copyright (C) 2017 Mario Prausa
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <FermatArray.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <cstdlib>
+#include <cstdint>
+using namespace std;
+
+struct Options {
+    string fermat;
+    int size;
+    int iterations;
+    uint32_t seed;
+};
+
+struct Scenario {
+    string name;
+    function<void(Fermat&,const Options&,vector<double>&)> run;
+};
+
+static uint32_t lcg(uint32_t &state) {
+    state = state*1664525u + 1013904223u;
+    return state >> 8;
+}
+
+// deterministic, diagonally dominant (hence regular) integer matrix
+static string matrix(int n, uint32_t seed) {
+    stringstream strm;
+    uint32_t state = seed;
+
+    strm << "{";
+    for (int i=0; i<n; ++i) {
+        if (i) strm << ",";
+        strm << "{";
+        for (int j=0; j<n; ++j) {
+            if (j) strm << ",";
+            int entry = (int)(lcg(state)%199)-99;
+            if (i == j) entry += 100*n;
+            strm << entry;
+        }
+        strm << "}";
+    }
+    strm << "}";
+
+    return strm.str();
+}
+
+template<class F>
+static void timed(vector<double> &lat, F f) {
+    auto start = chrono::steady_clock::now();
+    f();
+    auto stop = chrono::steady_clock::now();
+
+    lat.push_back(chrono::duration<double,micro>(stop-start).count());
+}
+
+static vector<Scenario> scenarios() {
+    vector<Scenario> res;
+
+    res.push_back({"roundtrip",[](Fermat &fermat, const Options &opt, vector<double> &lat) {
+        for (int n=0; n<opt.iterations; ++n) {
+            timed(lat,[&] { fermat("1"); });
+        }
+    }});
+
+    res.push_back({"expression",[](Fermat &fermat, const Options &opt, vector<double> &lat) {
+        FermatExpression a(&fermat,"3/7*x+y"), b(&fermat,"11/5*y^2"), c(&fermat,13);
+
+        for (int n=0; n<opt.iterations; ++n) {
+            timed(lat,[&] { FermatExpression r = a*b + c - a/c; });
+        }
+    }});
+
+    res.push_back({"array_string",[](Fermat &fermat, const Options &opt, vector<double> &lat) {
+        string str = matrix(opt.size,opt.seed);
+
+        for (int n=0; n<opt.iterations; ++n) {
+            timed(lat,[&] { FermatArray m(&fermat,str); });
+        }
+    }});
+
+    res.push_back({"array_set",[](Fermat &fermat, const Options &opt, vector<double> &lat) {
+        FermatArray m(&fermat,opt.size,opt.size);
+        uint32_t state = opt.seed;
+
+        for (int n=0; n<opt.iterations; ++n) {
+            int i = 1 + (int)(lcg(state)%opt.size);
+            int j = 1 + (int)(lcg(state)%opt.size);
+            int v = (int)(lcg(state)%1000);
+
+            timed(lat,[&] { m.set(i,j,v); });
+        }
+    }});
+
+    res.push_back({"array_mul",[](Fermat &fermat, const Options &opt, vector<double> &lat) {
+        FermatArray m(&fermat,matrix(opt.size,opt.seed));
+
+        for (int n=0; n<opt.iterations; ++n) {
+            timed(lat,[&] { FermatArray p = m*m; });
+        }
+    }});
+
+    res.push_back({"det",[](Fermat &fermat, const Options &opt, vector<double> &lat) {
+        FermatArray m(&fermat,matrix(opt.size,opt.seed));
+
+        for (int n=0; n<opt.iterations; ++n) {
+            timed(lat,[&] { FermatExpression d = m.det(); });
+        }
+    }});
+
+    res.push_back({"inverse",[](Fermat &fermat, const Options &opt, vector<double> &lat) {
+        FermatArray m(&fermat,matrix(opt.size,opt.seed));
+
+        for (int n=0; n<opt.iterations; ++n) {
+            timed(lat,[&] { FermatArray inv = m.inverse(); });
+        }
+    }});
+
+    res.push_back({"str",[](Fermat &fermat, const Options &opt, vector<double> &lat) {
+        FermatArray m(&fermat,matrix(4*opt.size,opt.seed));
+        FermatArray big = m*m*m;
+
+        for (int n=0; n<opt.iterations; ++n) {
+            timed(lat,[&] { string s = big.str(); });
+        }
+    }});
+
+    return res;
+}
+
+static double percentile(vector<double> lat, double p) {
+    if (lat.empty()) return 0;
+
+    sort(lat.begin(),lat.end());
+    size_t idx = (size_t)(p*(lat.size()-1)+0.5);
+
+    return lat[idx];
+}
+
+static void usage(string progname) {
+    cerr << "Usage: " << progname << " OPTIONS [SCENARIO...]" << endl << endl;
+    cerr << left;
+
+    cerr << "OPTIONS:" << endl;
+    cerr << setw(60) << "   --fermat <path>"                                         << "Fermat (or fermat_sim) executable. (default: $FERMAT or fer64)" << endl;
+    cerr << setw(60) << "   --size <n>"                                              << "Matrix dimension. (default: 8)" << endl;
+    cerr << setw(60) << "   --iterations <n>"                                        << "Operations per scenario. (default: 200)" << endl;
+    cerr << setw(60) << "   --seed <n>"                                              << "Seed for the generated matrices. (default: 1)" << endl;
+    cerr << setw(60) << "   --help"                                                  << "this help text." << endl;
+    cerr << endl;
+
+    cerr << "SCENARIOS:" << endl;
+    for (auto &s : scenarios()) {
+        cerr << "   " << s.name << endl;
+    }
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    Options opt;
+    vector<string> selected;
+
+    opt.fermat = getenv("FERMAT") ? getenv("FERMAT") : "fer64";
+    opt.size = 8;
+    opt.iterations = 200;
+    opt.seed = 1;
+
+    for (int n=1; n<argc; ++n) {
+        string arg = argv[n];
+
+        if (arg == "--fermat") {
+            if (++n == argc) usage(argv[0]);
+            opt.fermat = argv[n];
+        } else if (arg == "--size") {
+            if (++n == argc) usage(argv[0]);
+            opt.size = atoi(argv[n]);
+        } else if (arg == "--iterations") {
+            if (++n == argc) usage(argv[0]);
+            opt.iterations = atoi(argv[n]);
+        } else if (arg == "--seed") {
+            if (++n == argc) usage(argv[0]);
+            opt.seed = (uint32_t)atol(argv[n]);
+        } else if (arg.compare(0,2,"--") == 0) {
+            usage(argv[0]);
+        } else {
+            selected.push_back(arg);
+        }
+    }
+
+    if (opt.size <= 0 || opt.iterations <= 0) usage(argv[0]);
+
+    Fermat fermat(opt.fermat);
+
+    // the expression scenario works on polynomials in these
+    fermat.addSymbol("x");
+    fermat.addSymbol("y");
+
+    cout << left << setw(14) << "scenario" << right
+         << setw(8) << "ops"
+         << setw(12) << "ops/s"
+         << setw(12) << "p50 [us]"
+         << setw(12) << "p99 [us]"
+         << setw(14) << "bytes/op"
+         << setw(12) << "trips/op" << endl;
+
+    for (auto &s : scenarios()) {
+        if (!selected.empty() && find(selected.begin(),selected.end(),s.name) == selected.end()) continue;
+
+        vector<double> lat;
+
+        fermat.collect();
+        FermatPipe::Stats before = fermat.pipe().stats();
+        auto start = chrono::steady_clock::now();
+
+        s.run(fermat,opt,lat);
+        fermat.collect();
+
+        auto stop = chrono::steady_clock::now();
+        FermatPipe::Stats after = fermat.pipe().stats();
+
+        double secs = chrono::duration<double>(stop-start).count();
+        double ops = lat.size();
+        double bytes = (after.bytesRead-before.bytesRead) + (after.bytesWritten-before.bytesWritten);
+        double trips = after.batches-before.batches;
+
+        cout << left << setw(14) << s.name << right << fixed
+             << setw(8) << lat.size()
+             << setw(12) << setprecision(0) << ops/secs
+             << setw(12) << setprecision(1) << percentile(lat,0.5)
+             << setw(12) << setprecision(1) << percentile(lat,0.99)
+             << setw(14) << setprecision(0) << bytes/ops
+             << setw(12) << setprecision(2) << trips/ops << endl;
+    }
+
+    return 0;
+}
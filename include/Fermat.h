@@ -23,26 +23,230 @@
 #define __FERMAT_H
 
 #include <string>
-#include <lfpstream.h>
+#include <vector>
+#include <deque>
+#include <unordered_set>
+#include <unordered_map>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <FermatPipe.h>
+#include <FermatStats.h>
+#include <FermatTrace.h>
+#include <FermatResponse.h>
 
 class Fermat {
     protected:
         std::string _path;
-        redi::pstream strm;
+        FermatPipe strm;
         int serial;
         bool verbose;
+        bool batching;
+
+        struct Queued {
+            std::string cmd;
+            bool own;               // issued by the caller, not a deletion
+        };
+
+        std::vector<Queued> queue;
+        std::vector<std::string> drained;       // responses to queued commands sent early
+        std::vector<std::exception_ptr> drainedErrors;
+
+        struct AsyncJob {
+            std::string cmd;
+            bool strip;
+            FermatResponse::Sink *sink;
+            std::chrono::steady_clock::time_point deadline;
+            std::promise<std::string> result;
+        };
+
+        std::thread worker;
+        mutable std::mutex mtx;
+        std::condition_variable cv;
+        std::deque<AsyncJob> jobs;
+        bool stopping;
+
+        std::vector<std::string> garbage;
+        size_t gcThreshold;
+        std::vector<std::string> freeNames[2];  // released scalar and array names
+        std::unordered_set<std::string> live[2];  // handed out, not yet released
+        std::unordered_set<std::string> vectors;  // arrays declared with a single index
+        std::vector<std::string> symbols;       // guarded by mtx, read by the I/O thread
+        std::atomic<bool> scratch;      // the array for isZero() is declared
+
+        std::chrono::milliseconds timeout;
+        std::chrono::steady_clock::time_point sessionDeadline;
+
+        std::atomic<uint64_t> versions;
+        std::atomic<uint64_t> restartVersion;   // versions before the last restart are void
+
+        struct MemoEntry {
+            std::string name;       // variable holding the result
+            bool array;
+            int rows;
+            int cols;
+        };
+
+        std::atomic<size_t> memoCapacity;
+        std::mutex memoMtx;
+        std::unordered_map<std::string,MemoEntry> memo;
+        std::deque<std::string> memoOrder;      // keys, oldest first
+        uint64_t memoHits;
+        uint64_t memoMisses;
+
+        std::atomic<bool> instrumented;
+        std::mutex statsMtx;
+        FermatStats _stats;
+
+        std::atomic<bool> tracing;
+        std::unique_ptr<FermatTrace> tracer;
+        std::chrono::steady_clock::time_point traceStart;
     public:
-        Fermat(std::string path, bool verbose=false);
+        Fermat(std::string path, bool verbose=false, size_t bufsize=FermatPipe::defaultBufferSize);
         ~Fermat();
 
         std::string path() const;
-        redi::pstream &stream(); 
+        FermatPipe &pipe();
         void addSymbol(std::string sym);
         void dropSymbol(std::string sym);
-        std::string getUnique();
+        // the symbols, including those added or dropped by raw &(J=x) and
+        // &(J=-x) commands
+        std::vector<std::string> symbolNames() const;
+        std::string getUnique(bool array=false);
         std::string operator() (std::string in);
+        std::string operator() (std::string in, std::chrono::milliseconds timeout);
+
+        // like operator(), but all whitespace is removed from the response
+        // while it is read. The response is always read: queued batch
+        // commands are submitted first.
+        std::string stripped(std::string in);
+
+        // the same for a sequence of commands which are sent back to back,
+        // like submit(). Queued batch commands are submitted first.
+        std::vector<std::string> stripped(const std::vector<std::string> &in);
+
+        // streams the whitespace-free response into sink chunk by chunk
+        // instead of returning it. Queued batch commands are submitted
+        // first. Once the I/O thread runs, sink is called from there.
+        void stream(std::string in, FermatResponse::Sink &sink);
+
+        // batch mode: commands are queued instead of being executed and
+        // operator() returns an empty string; submit() sends them back to
+        // back and returns the responses. Commands whose response is read
+        // (stripped(), stream(), the queries of FermatExpression and
+        // FermatArray) send the queue first and are executed right away;
+        // the responses of the queued commands are kept. submit() returns
+        // one response per queued command and rethrows the first error,
+        // submit(errors) reports them per command instead.
+        void batch();
+        std::vector<std::string> submit();
+        std::vector<std::string> submit(std::vector<std::exception_ptr> &errors);
+        std::vector<std::string> submit(const std::vector<std::string> &in);
+
+        // asynchronous mode: commands are executed in FIFO order by an I/O
+        // thread which owns the pipe from the first call on. Synchronous
+        // calls are routed through the same queue once it is running.
+        // Commands queued by batch() are sent ahead of the new one.
+        std::future<std::string> async(std::string in);
+
+        // deferred deletion: released variables are deleted with a single
+        // @(...) command, sent along with the next command or as soon as
+        // the threshold is reached. collect() deletes them right away.
+        // Released names are handed out again by getUnique().
+        void release(const std::string &name, bool array=false);
+        void collect();
+        void setCollectThreshold(size_t n);
+
+        // checkpoint() writes the values of all live variables, the added
+        // symbols and the naming state to file; restore() brings a fresh
+        // session to that state. The variables are picked up again with
+        // FermatExpression::adopt() and FermatArray::adopt() by name.
+        // Arrays are written dense, sparse ones come back as dense arrays;
+        // arrays with a single index keep it.
+        void checkpoint(const std::string &file);
+        void restore(const std::string &file);
+
+        // used by FermatArray: arrays declared with a single index keep
+        // it through checkpoint() and restore().
+        void markVector(const std::string &name);
+        bool isVector(const std::string &name) const;
+
+        // timeouts: a command which is not answered in time throws
+        // FermatTimeout. The Fermat process is killed and started again with
+        // the same symbols, all variables are lost. setTimeout() bounds
+        // every command, setDeadline() the whole session; zero and
+        // time_point::max() switch them off.
+        void setTimeout(std::chrono::milliseconds timeout);
+        void setDeadline(std::chrono::steady_clock::time_point deadline);
+
+        // true if expr is zero. It is tested inside Fermat with Iszero on a
+        // scratch array, only the flag is read back.
+        bool isZero(const std::string &expr);
+
+        // version stamps: unique across the session, so a version
+        // identifies a value even though names are recycled (copies share
+        // it). A version is current until Fermat had to be restarted.
+        uint64_t newVersion();
+        bool isCurrent(uint64_t version) const;
+
+        // operation memo: products, substitutions and derivatives of
+        // expressions and determinants, inverses and transposes of arrays
+        // are kept in variables of their own, keyed by the operation and the
+        // versions of its operands. Repeating an operation on unchanged
+        // operands copies the kept result instead of computing it again.
+        // Beyond capacity the oldest results are deleted; zero switches the
+        // memo off (the default). It is not used in batch mode.
+        struct MemoStats {
+            uint64_t hits;
+            uint64_t misses;
+            size_t entries;
+        };
+
+        void memoize(size_t capacity=1024);
+        void clearMemo();
+        MemoStats memoStats();
+
+        // used by FermatExpression and FermatArray: memoFind() looks up a
+        // kept result, memoAdd() hands the variable name over to the memo.
+        bool memoizing() const;
+        bool memoFind(const std::string &key, std::string &name, int &rows, int &cols);
+        void memoAdd(const std::string &key, const std::string &name, bool array, int rows=0, int cols=0);
+
+        // instrumentation: while switched on every command is classified and
+        // its latency (from being written until the response is read), size
+        // and outcome are recorded. Switched off it costs a single flag test.
+        void instrument(bool on=true);
+        FermatStats stats();
+        void resetStats();
+
+        // binary trace: every command is appended to the file with its
+        // timestamp, duration, response size and outcome. The file is
+        // written by a background thread; see FermatTrace and fermat_trace.
+        // stopTrace() returns the number of records dropped because the
+        // writer could not keep up.
+        void trace(const std::string &file, size_t capacity=FermatTrace::defaultCapacity);
+        uint64_t stopTrace();
     private:
+        typedef std::chrono::steady_clock::time_point TimePoint;
+
         bool check();
+        TimePoint stamp() const;
+        TimePoint deadlineAfter(std::chrono::milliseconds timeout) const;
+        void respawn();
+        void trackSymbols(const std::string &in);
+        std::string execute(std::string in, bool strip, FermatResponse::Sink *sink, TimePoint deadline);
+        std::future<std::string> enqueue(std::string in, bool strip, FermatResponse::Sink *sink, TimePoint deadline);
+        std::string receive(const std::string &in, TimePoint start=TimePoint(), bool strip=false, FermatResponse::Sink *sink=NULL);
+        void pipeline(const std::vector<std::string> &in, bool strip, std::vector<std::string> &out, std::vector<std::exception_ptr> &errors);
+        std::vector<std::string> sequence(const std::vector<std::string> &in, bool strip);
+        void flush();
+        void account(const std::string &in, TimePoint start, size_t read, bool error);
+        std::string garbageCommand();
+        void run();
 };
 
 #endif //__FERMAT_H
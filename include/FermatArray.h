@@ -26,6 +26,11 @@
 #include <Fermat.h>
 #include <FermatExpression.h>
 #include <string>
+#include <map>
+#include <functional>
+#include <vector>
+
+class FermatPool;
 
 class FermatArray {
 	protected:
@@ -33,9 +38,11 @@ class FermatArray {
         std::string _name;
         int r;
         int c;
+        uint64_t _version;
     public:
         FermatArray();
         FermatArray(const FermatArray &array);
+        FermatArray(FermatArray &&array) noexcept;
         FermatArray(Fermat *fermat);
         FermatArray(Fermat *fermat, int n);
         FermatArray(Fermat *fermat, int r, int c, bool sparse=false);
@@ -46,6 +53,9 @@ class FermatArray {
 
         virtual ~FermatArray();
 
+        // takes over an array restored by Fermat::restore()
+        static FermatArray adopt(Fermat *fermat, const std::string &name);
+
         void set(int r, int c, const FermatExpression &expr);
         void set(int n, const FermatExpression &expr);
         void set(int r, int c, std::string expr);
@@ -66,6 +76,12 @@ class FermatArray {
         std::string name() const;
         Fermat *fer() const;
 
+        // changes of the entries give a new version, which keys the memo
+        // (see Fermat::memoize). Call modified() after changing name()
+        // directly.
+        uint64_t version() const;
+        void modified();
+
         int rows() const;
         int cols() const;
         
@@ -85,6 +101,7 @@ class FermatArray {
         FermatArray operator-() const;
 
         FermatArray &operator=(const FermatArray &array);
+        FermatArray &operator=(FermatArray &&array);
         FermatArray &operator*=(int i);
         FermatArray &operator+=(const FermatArray &array);
         FermatArray &operator-=(const FermatArray &array);
@@ -95,8 +112,27 @@ class FermatArray {
         FermatArray subst(std::string symbol, int i) const;
         FermatArray subst(std::string symbol, const FermatExpression &ex) const;
 
+        // all symbols in a single substitution #(a=..,b=..)
+        FermatArray subst(const std::map<std::string,FermatExpression> &repl) const;
+        FermatArray subst(const std::map<std::string,int> &repl) const;
+
+        // the first derivatives of a vector as a rows x symbols.size()
+        // array, one pipelined command per row. With a pool the rows are
+        // differentiated by its workers, which must know the symbols; the
+        // entries travel there and back as text.
+        FermatArray jacobian(const std::vector<std::string> &symbols) const;
+        FermatArray jacobian(const std::vector<std::string> &symbols, FermatPool &pool) const;
+
         virtual std::string str() const;
         virtual std::string sstr() const;
+
+        // streams the entries as (row, column, text) while they are read
+        // off the pipe, without holding the whole array in memory. With
+        // sparse only the non-zero entries are listed.
+        void elements(const std::function<void(int,int,const std::string&)> &callback, bool sparse=false) const;
+    protected:
+        // assigns cmd; with a key the result is copied from or kept in the memo
+        void evaluate(const std::string &cmd, const std::string &key);
 };
 
 #endif //__FERMAT_ARRAY_H
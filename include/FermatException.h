@@ -42,5 +42,11 @@ class FermatDivByZero : public FermatException {
         FermatDivByZero(const std::string &msg) : FermatException(msg) {}
 };
 
+// the deadline passed; Fermat was restarted and all its variables are lost
+class FermatTimeout : public FermatException {
+    public:
+        FermatTimeout(const std::string &msg) : FermatException(msg) {}
+};
+
 #endif //__FERMAT_EXCEPTION_H
 
@@ -23,49 +23,435 @@
 #define __FERMAT_EXPRESSION_H
 
 #include <Fermat.h>
+#include <FermatRational.h>
+#include <FermatPolynomial.h>
 #include <string>
+#include <map>
+#include <stdexcept>
+#include <type_traits>
+#include <cstdint>
 
+class FermatArray;
+
+// base of the lazy nodes built by the arithmetic operators, see below
+class FermatNode {};
+
+/*
+ *  Rational constants are kept in the process: they are built, combined
+ *  with each other and printed without talking to Fermat, and enter
+ *  commands as literals. A variable is only created when name() is asked
+ *  for; from then on the value lives in Fermat, as the caller may assign
+ *  to it. Local values are not part of a Fermat::checkpoint().
+ */
 class FermatExpression {
+    friend class FermatArray;
+    friend class FermatRef;
     protected:
         Fermat *fermat;
-        std::string _name;
+        mutable std::string _name;      // empty for a constant not yet in Fermat
+        mutable uint64_t _version;
+        mutable bool _local;
+        FermatRational _value;          // the value, if _local
+
+        mutable std::string cache;      // str() of version cached
+        mutable uint64_t cached;
     public:
         FermatExpression();
         FermatExpression(const FermatExpression &expr);
+        FermatExpression(FermatExpression &&expr) noexcept;
         FermatExpression(Fermat *fermat);
         FermatExpression(Fermat *fermat, std::string expr);
         FermatExpression(Fermat *fermat, int num);
+        FermatExpression(Fermat *fermat, const FermatRational &num);
+        template<class E, class = typename std::enable_if<std::is_base_of<FermatNode,E>::value>::type>
+        FermatExpression(const E &node);
         ~FermatExpression();
+
+        // takes over a variable restored by Fermat::restore()
+        static FermatExpression adopt(Fermat *fermat, const std::string &name);
        
         std::string str() const;
         std::string name() const;
         Fermat *fer() const;
 
+        // true for a constant held in the process
+        bool isLocal() const;
+
+        // every new value gets a new version, which invalidates the cached
+        // str(); copies keep the version of their source. name() hands out
+        // a writable variable and takes a new version each time; call
+        // modified() after writing to a name kept from an earlier call.
+        uint64_t version() const;
+        void modified();
+
         FermatExpression &operator=(const std::string &expr);
         FermatExpression &operator=(int num);
+        FermatExpression &operator=(const FermatRational &num);
         FermatExpression &operator=(const FermatExpression &expr);
-
-        FermatExpression operator+(const FermatExpression &other) const;
-        FermatExpression operator-(const FermatExpression &other) const;
-        FermatExpression operator*(const FermatExpression &other) const;
-        FermatExpression operator*(int i) const;
-        FermatExpression operator/(const FermatExpression &other) const;
-        FermatExpression operator/(int i) const;
-        FermatExpression operator%(uint64_t i) const;
-        FermatExpression operator-() const;
+        FermatExpression &operator=(FermatExpression &&expr);
+        template<class E>
+        typename std::enable_if<std::is_base_of<FermatNode,E>::value,FermatExpression&>::type operator=(const E &node);
 
         bool operator==(const FermatExpression &other) const;
         bool operator<(const FermatExpression &other) const;
 
+        // predicates, evaluated inside Fermat; only a flag or a number is
+        // read back. A current cached str() answers isZero() and equals()
+        // locally. isConstant() and isPolynomial() look at the symbols of
+        // Fermat::symbolNames().
+        bool isZero() const;
+        bool isConstant() const;
+        bool isPolynomial() const;
+        bool equals(const FermatExpression &other) const;
+
         FermatExpression numer() const;
         FermatExpression denom() const;
+
+        // coefficients and exponents of numerator and denominator, parsed
+        // while the response is read
+        FermatTerms terms() const;
+
         int deg(std::string symbol) const;
         int codeg(std::string symbol) const;
 
         FermatExpression subst(std::string symbol, const FermatExpression &repl) const;
         FermatExpression subst(std::string symbol, int i) const;
+
+        // all symbols in a single substitution #(a=..,b=..)
+        FermatExpression subst(const std::map<std::string,FermatExpression> &repl) const;
+        FermatExpression subst(const std::map<std::string,int> &repl) const;
+
         FermatExpression deriv(std::string symbol, int n) const;
+
+        // the first derivatives as a 1 x symbols.size() array, built
+        // inside Fermat by a single command (include FermatArray.h)
+        FermatArray gradient(const std::vector<std::string> &symbols) const;
+
+        // the value at many points, substituted inside Fermat with one
+        // pipelined query per point; nothing is assigned. With several
+        // symbols every point holds one value per symbol. valuesAt() parses
+        // the results, which must be free of symbols.
+        std::vector<std::string> evalAt(const std::string &symbol, const std::vector<FermatRational> &points) const;
+        std::vector<std::string> evalAt(const std::vector<std::string> &symbols, const std::vector<std::vector<FermatRational>> &points) const;
+        std::vector<FermatRational> valuesAt(const std::string &symbol, const std::vector<FermatRational> &points) const;
+        std::vector<FermatRational> valuesAt(const std::vector<std::string> &symbols, const std::vector<std::vector<FermatRational>> &points) const;
+    protected:
+        bool hasCache() const;
+
+        // the variable, or the constant as a literal
+        std::string term() const;
+
+        // the substitution list a=..,b=.. for a command, with operands by
+        // version for the memo key
+        static std::string substList(const std::map<std::string,FermatExpression> &repl, bool tagged=false);
+        static std::string substList(const std::map<std::string,int> &repl);
+        void setLocal(const FermatRational &num);
+
+        // assigns cmd; with a key the result is copied from or kept in
+        // the memo, see Fermat::memoize()
+        void evaluate(const std::string &cmd, const std::string &key);
+        FermatExpression memoized(const std::string &cmd, const std::string &key) const;
+};
+
+/*
+ *  Expression templates: +, -, *, / (and * / % with integers, unary -)
+ *  don't talk to Fermat but build a tree of nodes referring to their
+ *  operands. The tree is sent as a single assignment once it is turned into
+ *  a FermatExpression, so a*b+c*d-e costs one round trip and no
+ *  temporaries. Nodes refer to their FermatExpression operands, so they
+ *  must be evaluated before the operands go away -- don't keep them in
+ *  `auto` variables.
+ */
+
+// leaf: an existing variable
+class FermatRef : public FermatNode {
+    public:
+        FermatRef(const FermatExpression &expr) : expr(&expr) {}
+
+        Fermat *fer() const {
+            return expr->fer();
+        }
+
+        bool costly() const {
+            return false;
+        }
+
+        bool local() const {
+            return expr->_local;
+        }
+
+        FermatRational value() const {
+            return expr->_value;
+        }
+
+        // tagged: operands by version instead of name, for the memo key
+        void text(std::string &out, bool, bool tagged=false) const {
+            if (!expr->fer()) throw std::invalid_argument("not initialized");
+
+            if (tagged && !expr->_local) {
+                out += '@';
+                out += std::to_string(expr->version());
+            } else {
+                out += expr->term();
+            }
+        }
+    private:
+        const FermatExpression *expr;
+};
+
+template<class D>
+class FermatLazy : public FermatNode {
+    public:
+        FermatExpression eval() const {
+            return FermatExpression(static_cast<const D&>(*this));
+        }
+
+        // the FermatExpression interface, on the evaluated node
+        std::string str() const { return eval().str(); }
+        FermatExpression numer() const { return eval().numer(); }
+        FermatExpression denom() const { return eval().denom(); }
+        int deg(std::string symbol) const { return eval().deg(symbol); }
+        int codeg(std::string symbol) const { return eval().codeg(symbol); }
+        FermatExpression subst(std::string symbol, const FermatExpression &repl) const { return eval().subst(symbol,repl); }
+        FermatExpression subst(std::string symbol, int i) const { return eval().subst(symbol,i); }
+        FermatExpression deriv(std::string symbol, int n) const { return eval().deriv(symbol,n); }
+        bool operator==(const FermatExpression &other) const { return eval() == other; }
+        bool isConstant() const { return eval().isConstant(); }
+        bool isPolynomial() const { return eval().isPolynomial(); }
+        bool equals(const FermatExpression &other) const { return eval().equals(other); }
+
+        // tested without a temporary
+        bool isZero() const {
+            const D &node = static_cast<const D&>(*this);
+
+            if (node.local()) return node.value().isZero();
+
+            return node.fer()->isZero(text());
+        }
+        bool operator<(const FermatExpression &other) const { return eval() < other; }
+
+        std::string text() const {
+            std::string out;
+            static_cast<const D*>(this)->text(out,false,false);
+            return out;
+        }
 };
 
+template<class L, class R>
+class FermatBinary : public FermatLazy<FermatBinary<L,R>> {
+    public:
+        FermatBinary(const L &l, char op, const R &r) : l(l), op(op), r(r) {}
+
+        Fermat *fer() const {
+            Fermat *fermat = l.fer();
+            return fermat ? fermat : r.fer();
+        }
+
+        // products and quotients are worth memoizing
+        bool costly() const {
+            return op == '*' || op == '/' || l.costly() || r.costly();
+        }
+
+        // division by zero is left to Fermat to report
+        bool local() const {
+            return l.local() && r.local() && (op != '/' || !r.value().isZero());
+        }
+
+        FermatRational value() const {
+            switch (op) {
+                case '+': return l.value()+r.value();
+                case '-': return l.value()-r.value();
+                case '*': return l.value()*r.value();
+                default: return l.value()/r.value();
+            }
+        }
+
+        using FermatLazy<FermatBinary<L,R>>::text;
+
+        void text(std::string &out, bool nested, bool tagged=false) const {
+            if (nested) out += '(';
+            l.text(out,true,tagged);
+            out += op;
+            r.text(out,true,tagged);
+            if (nested) out += ')';
+        }
+    private:
+        L l;
+        char op;
+        R r;
+};
+
+// operation with an integer constant
+template<class E>
+class FermatScalar : public FermatLazy<FermatScalar<E>> {
+    public:
+        FermatScalar(const E &e, char op, const std::string &num) : e(e), op(op), num(num) {}
+
+        Fermat *fer() const {
+            return e.fer();
+        }
+
+        bool costly() const {
+            return e.costly();
+        }
+
+        bool local() const {
+            return e.local() && (op == '*' || (op == '/' && num != "0"));
+        }
+
+        FermatRational value() const {
+            FermatRational n;
+
+            FermatRational::parse(num,n);
+
+            return op == '*' ? e.value()*n : e.value()/n;
+        }
+
+        using FermatLazy<FermatScalar<E>>::text;
+
+        void text(std::string &out, bool nested, bool tagged=false) const {
+            if (nested) out += '(';
+            e.text(out,true,tagged);
+            out += op;
+            out += '(';
+            out += num;
+            out += ')';
+            if (nested) out += ')';
+        }
+    private:
+        E e;
+        char op;
+        std::string num;
+};
+
+template<class E>
+class FermatNegate : public FermatLazy<FermatNegate<E>> {
+    public:
+        FermatNegate(const E &e) : e(e) {}
+
+        Fermat *fer() const {
+            return e.fer();
+        }
+
+        bool costly() const {
+            return e.costly();
+        }
+
+        bool local() const {
+            return e.local();
+        }
+
+        FermatRational value() const {
+            return -e.value();
+        }
+
+        using FermatLazy<FermatNegate<E>>::text;
+
+        void text(std::string &out, bool nested, bool tagged=false) const {
+            out += nested ? "(-" : " -";
+            e.text(out,true,tagged);
+            if (nested) out += ')';
+        }
+    private:
+        E e;
+};
+
+template<class T, bool = std::is_base_of<FermatExpression,T>::value>
+struct FermatOperand {
+    typedef T type;                 // nodes are stored by value
+    static const bool value = std::is_base_of<FermatNode,T>::value;
+};
+
+template<class T>
+struct FermatOperand<T,true> {
+    typedef FermatRef type;         // variables, also of derived classes, by reference
+    static const bool value = true;
+};
+
+template<class L, class R>
+using FermatBinaryOf = FermatBinary<typename FermatOperand<L>::type,typename FermatOperand<R>::type>;
+
+template<class E>
+using FermatScalarOf = FermatScalar<typename FermatOperand<E>::type>;
+
+template<class L, class R>
+typename std::enable_if<FermatOperand<L>::value && FermatOperand<R>::value,FermatBinaryOf<L,R>>::type operator+(const L &l, const R &r) {
+    return FermatBinaryOf<L,R>(l,'+',r);
+}
+
+template<class L, class R>
+typename std::enable_if<FermatOperand<L>::value && FermatOperand<R>::value,FermatBinaryOf<L,R>>::type operator-(const L &l, const R &r) {
+    return FermatBinaryOf<L,R>(l,'-',r);
+}
+
+template<class L, class R>
+typename std::enable_if<FermatOperand<L>::value && FermatOperand<R>::value,FermatBinaryOf<L,R>>::type operator*(const L &l, const R &r) {
+    return FermatBinaryOf<L,R>(l,'*',r);
+}
+
+template<class L, class R>
+typename std::enable_if<FermatOperand<L>::value && FermatOperand<R>::value,FermatBinaryOf<L,R>>::type operator/(const L &l, const R &r) {
+    return FermatBinaryOf<L,R>(l,'/',r);
+}
+
+template<class E>
+typename std::enable_if<FermatOperand<E>::value,FermatScalarOf<E>>::type operator*(const E &e, int i) {
+    return FermatScalarOf<E>(e,'*',std::to_string(i));
+}
+
+template<class E>
+typename std::enable_if<FermatOperand<E>::value,FermatScalarOf<E>>::type operator/(const E &e, int i) {
+    return FermatScalarOf<E>(e,'/',std::to_string(i));
+}
+
+template<class E>
+typename std::enable_if<FermatOperand<E>::value,FermatScalarOf<E>>::type operator%(const E &e, uint64_t i) {
+    return FermatScalarOf<E>(e,'|',std::to_string(i));
+}
+
+template<class E>
+typename std::enable_if<FermatOperand<E>::value,FermatNegate<typename FermatOperand<E>::type>>::type operator-(const E &e) {
+    return FermatNegate<typename FermatOperand<E>::type>(e);
+}
+
+template<class E, class>
+FermatExpression::FermatExpression(const E &node) : _version(0), _local(false), cached(0) {
+    std::string cmd, key;
+
+    if (node.local()) {
+        fermat = node.fer();
+        setLocal(node.value());
+        return;
+    }
+
+    node.text(cmd,false);
+
+    fermat = node.fer();
+    if (fermat->memoizing() && node.costly()) node.text(key,false,true);
+
+    evaluate(cmd,key);
+}
+
+template<class E>
+typename std::enable_if<std::is_base_of<FermatNode,E>::value,FermatExpression&>::type FermatExpression::operator=(const E &node) {
+    std::string cmd, key;
+
+    if (node.local()) {
+        if (!fermat) fermat = node.fer();
+        setLocal(node.value());
+        return *this;
+    }
+
+    node.text(cmd,false);   // the operands may include *this
+
+    if (!fermat) fermat = node.fer();
+
+    if (fermat->memoizing() && node.costly()) node.text(key,false,true);
+
+    evaluate(cmd,key);
+
+    return *this;
+}
+
 #endif //__FERMAT_EXPRESSION_H
 
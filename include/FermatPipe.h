@@ -0,0 +1,115 @@
+// vim: set expandtab shiftwidth=4 tabstop=4:
+
+/*
+ *  include/FermatPipe.h
+ *
+ *  Copyright (C) 2017 Mario Prausa
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FERMAT_PIPE_H
+#define __FERMAT_PIPE_H
+
+#include <string>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <sys/types.h>
+
+struct iovec;
+class FermatResponse;
+
+/*
+ *  Pipe transport to the Fermat child process. The child's stdout is read
+ *  with large read() calls into a ring buffer, lines are cut out of the
+ *  buffer with memchr and commands are written with a single writev().
+ *  While a write is blocked on a full pipe, pending output of the child is
+ *  drained into the buffer, so arbitrarily many commands can be written
+ *  back to back without deadlocking.
+ */
+class FermatPipe {
+    public:
+        struct Stats {
+            uint64_t bytesRead;
+            uint64_t bytesWritten;
+            uint64_t reads;         // read() syscalls
+            uint64_t writes;        // write()/writev() syscalls
+            uint64_t commands;      // command lines written
+            uint64_t batches;       // write requests, i.e. round trips
+        };
+
+        static const size_t defaultBufferSize = 1<<20;
+
+        FermatPipe(size_t bufsize=defaultBufferSize);
+        ~FermatPipe();
+
+        bool open(const std::string &cmd);
+        void close();
+        void kill();        // SIGKILL the child, then close
+        bool isOpen() const;
+        pid_t pid() const;
+
+        bool write(const std::string &line);
+        bool write(const std::string *lines, size_t n);
+        bool getline(std::string &str);
+
+        // feeds buffered output to the parser until it has seen the whole
+        // response; false if the pipe was closed before.
+        bool scan(FermatResponse &resp);
+
+        // reads and writes fail once the deadline has passed, timedOut()
+        // tells them apart from a closed pipe. time_point::max() disables it.
+        void setDeadline(std::chrono::steady_clock::time_point deadline);
+        bool timedOut() const;
+
+        size_t bufferSize() const;
+        Stats stats() const;
+        void resetStats();
+    private:
+        FermatPipe(const FermatPipe &);
+        FermatPipe &operator=(const FermatPipe &);
+
+        bool fill();
+        void grow();
+        int remaining();
+        bool writev(struct iovec *iov, int iovcnt);
+
+        pid_t _pid;
+        int wfd;
+        int rfd;
+
+        char *buf;
+        size_t cap;
+        size_t head;
+        size_t count;
+
+        std::chrono::steady_clock::time_point deadline;
+        bool _timedOut;
+
+        // counted by the thread using the pipe, read by stats() from any
+        struct Counters {
+            std::atomic<uint64_t> bytesRead;
+            std::atomic<uint64_t> bytesWritten;
+            std::atomic<uint64_t> reads;
+            std::atomic<uint64_t> writes;
+            std::atomic<uint64_t> commands;
+            std::atomic<uint64_t> batches;
+        };
+
+        Counters _stats;
+};
+
+#endif //__FERMAT_PIPE_H
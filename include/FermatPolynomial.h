@@ -0,0 +1,87 @@
+// vim: set expandtab shiftwidth=4 tabstop=4:
+
+/*
+ *  include/FermatPolynomial.h
+ *
+ *  Copyright (C) 2017 Mario Prausa
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FERMAT_POLYNOMIAL_H
+#define __FERMAT_POLYNOMIAL_H
+
+#include <FermatRational.h>
+#include <FermatResponse.h>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+/*
+ *  Sparse multivariate polynomial as flat arrays: term t has the
+ *  coefficient coefficients[t] and the exponents
+ *  exponents[t*symbols.size() ... (t+1)*symbols.size()-1], one per symbol.
+ *  Terms are kept in the order Fermat prints them.
+ */
+class FermatPolynomial {
+    public:
+        std::vector<std::string> symbols;
+        std::vector<FermatRational> coefficients;
+        std::vector<int> exponents;
+
+        FermatPolynomial();
+        explicit FermatPolynomial(const std::vector<std::string> &symbols);
+
+        size_t size() const;
+        const FermatRational &coefficient(size_t term) const;
+        int exponent(size_t term, size_t symbol) const;
+        int symbolIndex(const std::string &symbol);     // the column is added if needed
+
+        void addTerm(const FermatRational &coefficient, const int *exps);
+
+        // parses the normalized output of Fermat for a polynomial, e.g.
+        // "3*x^2*y - 1/2*y + 7"; throws invalid_argument otherwise.
+        static FermatPolynomial parse(const std::string &text, const std::vector<std::string> &symbols=std::vector<std::string>());
+
+        // the same, one pass over the response while it is read
+        class Parser : public FermatResponse::Sink {
+            public:
+                explicit Parser(FermatPolynomial &poly);
+
+                void put(const char *data, size_t len);
+                void finish();
+            private:
+                void token();
+                void term();
+
+                FermatPolynomial &poly;
+                std::string tok;
+                bool number;            // tok is a number
+                bool power;             // tok is the exponent of symbol
+                bool started;           // the term has a factor
+                bool negative;
+                bool done;              // ";or ..." follows the value
+                int symbol;
+                FermatRational coeff;
+                std::vector<int> exps;
+        };
+};
+
+// a rational function as numerator and denominator
+struct FermatTerms {
+    FermatPolynomial numer;
+    FermatPolynomial denom;
+};
+
+#endif //__FERMAT_POLYNOMIAL_H
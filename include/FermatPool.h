@@ -0,0 +1,114 @@
+// vim: set expandtab shiftwidth=4 tabstop=4:
+
+/*
+ *  include/FermatPool.h
+ *
+ *  Copyright (C) 2017 Mario Prausa
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FERMAT_POOL_H
+#define __FERMAT_POOL_H
+
+#include <Fermat.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+/*
+ *  A pool of Fermat processes. Every worker thread owns one Fermat instance
+ *  and a deque of jobs; jobs are distributed round robin and idle workers
+ *  steal from the back of the other deques. A job is any callable taking a
+ *  Fermat& -- all Fermat objects it creates live in that worker's process,
+ *  so a job has to hand back plain data (strings, numbers).
+ */
+class FermatPool {
+    public:
+        typedef std::function<void(Fermat&)> Job;
+
+        FermatPool(std::string path, int n=0, bool verbose=false);
+        ~FermatPool();
+
+        int size() const;
+
+        void addSymbol(std::string sym);
+        void dropSymbol(std::string sym);
+
+        template<class F>
+        auto submit(F f) -> std::future<decltype(f(std::declval<Fermat&>()))>;
+        template<class F>
+        auto submitTo(int worker, F f) -> std::future<decltype(f(std::declval<Fermat&>()))>;
+        std::future<std::string> submit(std::string cmd);
+
+        void wait();
+    private:
+        FermatPool(const FermatPool &);
+        FermatPool &operator=(const FermatPool &);
+
+        struct Worker {
+            std::unique_ptr<Fermat> fermat;
+            std::mutex mtx;
+            std::deque<Job> jobs;       // may be stolen by other workers
+            std::deque<Job> pinned;     // must run on this worker
+            int npinned;
+            std::thread thr;
+        };
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::condition_variable idle;
+        int stealable;
+        int outstanding;
+        bool stopping;
+        std::atomic<unsigned> next;
+
+        void post(Job job, int pin=-1);
+        bool take(int n, Job &job);
+        void run(int n);
+};
+
+template<class F>
+auto FermatPool::submit(F f) -> std::future<decltype(f(std::declval<Fermat&>()))> {
+    typedef decltype(f(std::declval<Fermat&>())) R;
+
+    auto task = std::make_shared<std::packaged_task<R(Fermat&)>>(std::move(f));
+    std::future<R> res = task->get_future();
+
+    post([task](Fermat &fermat) { (*task)(fermat); });
+
+    return res;
+}
+
+template<class F>
+auto FermatPool::submitTo(int worker, F f) -> std::future<decltype(f(std::declval<Fermat&>()))> {
+    typedef decltype(f(std::declval<Fermat&>())) R;
+
+    auto task = std::make_shared<std::packaged_task<R(Fermat&)>>(std::move(f));
+    std::future<R> res = task->get_future();
+
+    post([task](Fermat &fermat) { (*task)(fermat); },worker);
+
+    return res;
+}
+
+#endif //__FERMAT_POOL_H
@@ -0,0 +1,116 @@
+// vim: set expandtab shiftwidth=4 tabstop=4:
+
+/*
+ *  include/FermatRational.h
+ *
+ *  Copyright (C) 2017 Mario Prausa
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FERMAT_RATIONAL_H
+#define __FERMAT_RATIONAL_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/*
+ *  Arbitrary precision integers (base 2^32 limbs, sign + magnitude) and
+ *  normalized rationals on top of them.
+ */
+class FermatInteger {
+    protected:
+        std::vector<uint32_t> mag;      // little endian, no leading zero limbs
+        bool neg;
+    public:
+        FermatInteger();
+        FermatInteger(long long i);
+
+        static bool parse(const std::string &str, FermatInteger &res);
+        std::string str() const;
+
+        bool isZero() const;
+        bool isNegative() const;
+        bool isOne() const;
+        bool fitsInt() const;
+        long long toInt() const;
+        int sign() const;
+
+        FermatInteger abs() const;
+        FermatInteger operator-() const;
+        FermatInteger operator+(const FermatInteger &other) const;
+        FermatInteger operator-(const FermatInteger &other) const;
+        FermatInteger operator*(const FermatInteger &other) const;
+        FermatInteger operator/(const FermatInteger &other) const;  // truncating
+        FermatInteger operator%(const FermatInteger &other) const;
+
+        FermatInteger &operator+=(const FermatInteger &other);
+        FermatInteger &operator-=(const FermatInteger &other);
+        FermatInteger &operator*=(const FermatInteger &other);
+
+        bool operator==(const FermatInteger &other) const;
+        bool operator!=(const FermatInteger &other) const;
+        bool operator<(const FermatInteger &other) const;
+
+        static void divmod(const FermatInteger &a, const FermatInteger &b, FermatInteger &q, FermatInteger &r);
+        static FermatInteger gcd(FermatInteger a, FermatInteger b);
+    private:
+        void trim();
+        static int cmpMag(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b);
+        static std::vector<uint32_t> addMag(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b);
+        static std::vector<uint32_t> subMag(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b);
+        static std::vector<uint32_t> mulMag(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b);
+        static void divMag(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b,
+                           std::vector<uint32_t> &q, std::vector<uint32_t> &r);
+        static uint32_t divSmall(std::vector<uint32_t> &a, uint32_t d);
+};
+
+class FermatRational {
+    protected:
+        FermatInteger num;
+        FermatInteger den;    // always positive
+    public:
+        FermatRational();
+        FermatRational(long long i);
+        FermatRational(const FermatInteger &num, const FermatInteger &den=FermatInteger(1));
+
+        static bool parse(const std::string &str, FermatRational &res);
+        std::string str() const;
+
+        const FermatInteger &numer() const;
+        const FermatInteger &denom() const;
+
+        bool isZero() const;
+        bool isInteger() const;
+        int sign() const;
+
+        FermatRational operator-() const;
+        FermatRational operator+(const FermatRational &other) const;
+        FermatRational operator-(const FermatRational &other) const;
+        FermatRational operator*(const FermatRational &other) const;
+        FermatRational operator/(const FermatRational &other) const;
+
+        FermatRational &operator+=(const FermatRational &other);
+        FermatRational &operator-=(const FermatRational &other);
+        FermatRational &operator*=(const FermatRational &other);
+
+        bool operator==(const FermatRational &other) const;
+        bool operator!=(const FermatRational &other) const;
+        bool operator<(const FermatRational &other) const;
+    private:
+        void normalize();
+};
+
+#endif //__FERMAT_RATIONAL_H
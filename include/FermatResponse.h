@@ -0,0 +1,90 @@
+// vim: set expandtab shiftwidth=4 tabstop=4:
+
+/*
+ *  include/FermatResponse.h
+ *
+ *  Copyright (C) 2017 Mario Prausa
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FERMAT_RESPONSE_H
+#define __FERMAT_RESPONSE_H
+
+#include <string>
+#include <functional>
+#include <exception>
+#include <cstddef>
+
+/*
+ *  Incremental parser for the response to a single command. Bytes are fed
+ *  in as they arrive from the pipe and are looked at exactly once: blank
+ *  lines are skipped, the echoed prompt on the first line is removed, the
+ *  closing ">" line ends the response, "***" error markers are detected
+ *  and the text is appended to the output, optionally with all whitespace
+ *  removed. The first headSize bytes of the unstripped text are kept for
+ *  error messages.
+ *
+ *  With a sink the text is handed on after every chunk instead of being
+ *  collected, so arbitrarily large responses are read in bounded memory.
+ */
+class FermatResponse {
+    public:
+        class Sink {
+            public:
+                virtual ~Sink() {}
+                virtual void put(const char *data, size_t len) = 0;
+        };
+
+        static const size_t headSize = 1<<16;
+
+        explicit FermatResponse(bool strip=false, Sink *sink=NULL);
+
+        // consumes bytes up to and including the closing prompt line and
+        // returns how many were consumed.
+        size_t feed(const char *data, size_t len);
+
+        bool done() const;
+        bool error() const;
+        size_t consumed() const;
+
+        std::string &output();
+        const std::string &head() const;
+
+        // exception thrown by the sink; the sink is not called after that.
+        std::exception_ptr sinkError() const;
+
+        // called with every complete line (without the prompt), for verbose mode
+        std::function<void(const std::string&)> onLine;
+    private:
+        void emit(char c);
+
+        bool strip;
+        Sink *sink;
+        std::exception_ptr _sinkError;
+        bool _done;
+        bool _error;
+        bool first;         // no non-blank line seen yet
+        bool pending;       // a leading '>' not yet known to be part of the text
+        size_t column;      // raw bytes in the current line
+        size_t text;        // text bytes in the current line
+        int stars;
+        size_t _consumed;
+
+        std::string out;
+        std::string _head;
+        std::string line;
+};
+
+#endif //__FERMAT_RESPONSE_H
@@ -0,0 +1,70 @@
+// vim: set expandtab shiftwidth=4 tabstop=4:
+
+/*
+ *  include/FermatSpares.h
+ *
+ *  Copyright (C) 2017 Mario Prausa
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FERMAT_SPARES_H
+#define __FERMAT_SPARES_H
+
+#include <Fermat.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+/*
+ *  Keeps a number of started and checked Fermat processes in reserve, with
+ *  the given symbols already added. acquire() hands one out right away and
+ *  a background thread starts its replacement; only when no spare is left
+ *  it falls back to starting a process itself. If a background start
+ *  failed, the next acquire() without a spare rethrows that error and the
+ *  starts are resumed.
+ */
+class FermatSpares {
+    public:
+        FermatSpares(std::string path, int count=2, std::vector<std::string> symbols=std::vector<std::string>(), bool verbose=false);
+        ~FermatSpares();
+
+        std::unique_ptr<Fermat> acquire();
+        int ready();
+    private:
+        FermatSpares(const FermatSpares &);
+        FermatSpares &operator=(const FermatSpares &);
+
+        std::unique_ptr<Fermat> start() const;
+        void run();
+
+        std::string path;
+        int count;
+        std::vector<std::string> symbols;
+        bool verbose;
+
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::deque<std::unique_ptr<Fermat>> spares;
+        std::exception_ptr error;   // the last start failed, don't retry
+        bool stopping;
+        std::thread thr;
+};
+
+#endif //__FERMAT_SPARES_H
@@ -0,0 +1,81 @@
+// vim: set expandtab shiftwidth=4 tabstop=4:
+
+/*
+ *  include/FermatStats.h
+ *
+ *  Copyright (C) 2017 Mario Prausa
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FERMAT_STATS_H
+#define __FERMAT_STATS_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ *  Per command kind counters and latency histograms, filled in by Fermat
+ *  while instrumentation is switched on. Histogram bucket n counts the
+ *  commands which took [2^n-1, 2^(n+1)-1) microseconds.
+ */
+class FermatStats {
+    public:
+        enum Kind {
+            Assignment,
+            Deletion,
+            Declaration,
+            Setting,
+            Print,
+            Det,
+            Trans,
+            Inverse,
+            Colreduce,
+            Redrowech,
+            Chpoly,
+            Iszero,
+            Deriv,
+            Subst,
+            Degree,
+            NumKinds
+        };
+
+        static const int buckets = 32;
+
+        struct Entry {
+            uint64_t count;
+            uint64_t errors;
+            uint64_t bytesWritten;
+            uint64_t bytesRead;
+            double time;                // microseconds
+            uint64_t histogram[buckets];
+        };
+
+        FermatStats();
+
+        static Kind classify(const std::string &cmd);
+        static const char *name(Kind kind);
+
+        void record(Kind kind, double us, size_t written, size_t read, bool error);
+        void reset();
+
+        const Entry &operator[](Kind kind) const;
+        Entry total() const;
+        double percentile(Kind kind, double p) const;
+    private:
+        Entry entries[NumKinds];
+};
+
+#endif //__FERMAT_STATS_H
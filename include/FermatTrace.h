@@ -0,0 +1,90 @@
+// vim: set expandtab shiftwidth=4 tabstop=4:
+
+/*
+ *  include/FermatTrace.h
+ *
+ *  Copyright (C) 2017 Mario Prausa
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FERMAT_TRACE_H
+#define __FERMAT_TRACE_H
+
+#include <string>
+#include <atomic>
+#include <thread>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ *  Binary trace of the command stream. Records are appended by the thread
+ *  doing the Fermat I/O to a single producer/single consumer ring buffer
+ *  without taking a lock; a background thread writes them to the file.
+ *  When the buffer is full records are dropped rather than stalling the
+ *  caller.
+ *
+ *  File layout: the 8 byte magic "FERMTRC1" followed by records, each a
+ *  Record header (native byte order) followed by `length` bytes of the
+ *  command, truncated to maxCommand bytes.
+ */
+class FermatTrace {
+    public:
+        struct Record {
+            uint64_t time;          // nanoseconds since the trace was started
+            uint32_t duration;      // microseconds from write to response
+            uint32_t written;       // command bytes
+            uint32_t read;          // response bytes
+            uint16_t length;        // stored command bytes
+            uint8_t kind;           // FermatStats::Kind
+            uint8_t flags;
+        };
+
+        enum Flags {
+            Error = 1,
+            Truncated = 2
+        };
+
+        static const char magic[8];
+        static const size_t defaultCapacity = 1<<20;
+        static const size_t maxCommand = 1024;
+
+        FermatTrace(const std::string &path, size_t capacity=defaultCapacity);
+        ~FermatTrace();
+
+        void record(const std::string &cmd, uint64_t time, uint32_t duration, uint32_t read, uint8_t kind, bool error);
+        uint64_t dropped() const;
+
+        // reading back, used by fermat_trace
+        static bool readHeader(FILE *file);
+        static bool read(FILE *file, Record &rec, std::string &cmd);
+    private:
+        FermatTrace(const FermatTrace &);
+        FermatTrace &operator=(const FermatTrace &);
+
+        void put(const void *data, size_t n, size_t pos);
+        void run();
+
+        FILE *file;
+        char *buf;
+        size_t cap;                         // power of two
+        std::atomic<size_t> head;           // advanced by the producer
+        std::atomic<size_t> tail;           // advanced by the writer thread
+        std::atomic<uint64_t> _dropped;
+        std::atomic<bool> stopping;
+        std::thread writer;
+};
+
+#endif //__FERMAT_TRACE_H
@@ -0,0 +1,261 @@
+// vim: set expandtab shiftwidth=4 tabstop=4:
+
+/*
+ *  sim/Polynomial.cpp
+ *
+ *  Copyright (C) 2017 Mario Prausa
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Polynomial.h"
+#include <algorithm>
+#include <stdexcept>
+using namespace std;
+
+Polynomial::Polynomial() {}
+
+Polynomial::Polynomial(const Rational &c) {
+    add(Monomial(),c);
+}
+
+Polynomial Polynomial::symbol(int idx) {
+    Polynomial res;
+    Monomial m(idx+1,0);
+
+    m[idx] = 1;
+    res.add(m,Rational(1));
+
+    return res;
+}
+
+bool Polynomial::isZero() const {
+    return terms.empty();
+}
+
+bool Polynomial::isConstant() const {
+    return terms.empty() || (terms.size() == 1 && terms.begin()->first.empty());
+}
+
+Rational Polynomial::constant() const {
+    auto it = terms.find(Monomial());
+    return it == terms.end() ? Rational(0) : it->second;
+}
+
+int Polynomial::deg(int idx) const {
+    int d = 0;
+
+    for (auto &t : terms) {
+        if ((int)t.first.size() > idx) d = max(d,t.first[idx]);
+    }
+
+    return d;
+}
+
+int Polynomial::codeg(int idx) const {
+    int d = -1;
+
+    for (auto &t : terms) {
+        int e = (int)t.first.size() > idx ? t.first[idx] : 0;
+        if (d < 0 || e < d) d = e;
+    }
+
+    return max(d,0);
+}
+
+Integer Polynomial::denominator() const {
+    Integer l(1);
+
+    for (auto &t : terms) {
+        const Integer &d = t.second.denom();
+        l = l/Integer::gcd(l,d)*d;
+    }
+
+    return l;
+}
+
+Polynomial Polynomial::operator-() const {
+    Polynomial res = *this;
+
+    for (auto &t : res.terms) t.second = -t.second;
+
+    return res;
+}
+
+Polynomial Polynomial::operator+(const Polynomial &other) const {
+    Polynomial res = *this;
+
+    for (auto &t : other.terms) res.add(t.first,t.second);
+
+    return res;
+}
+
+Polynomial Polynomial::operator-(const Polynomial &other) const {
+    Polynomial res = *this;
+
+    for (auto &t : other.terms) res.add(t.first,-t.second);
+
+    return res;
+}
+
+Polynomial Polynomial::operator*(const Polynomial &other) const {
+    Polynomial res;
+
+    for (auto &a : terms) {
+        for (auto &b : other.terms) {
+            Monomial m(max(a.first.size(),b.first.size()),0);
+
+            for (size_t n=0; n<a.first.size(); ++n) m[n] += a.first[n];
+            for (size_t n=0; n<b.first.size(); ++n) m[n] += b.first[n];
+
+            res.add(m,a.second*b.second);
+        }
+    }
+
+    return res;
+}
+
+Polynomial Polynomial::operator*(const Rational &c) const {
+    if (c.isZero()) return Polynomial();
+
+    Polynomial res = *this;
+
+    for (auto &t : res.terms) t.second *= c;
+
+    return res;
+}
+
+Polynomial Polynomial::pow(int n) const {
+    if (n < 0) throw domain_error("negative exponent");
+
+    Polynomial res(Rational(1));
+    Polynomial base = *this;
+
+    while (n) {
+        if (n & 1) res = res*base;
+        n >>= 1;
+        if (n) base = base*base;
+    }
+
+    return res;
+}
+
+Polynomial Polynomial::subst(int idx, const Polynomial &value) const {
+    Polynomial res;
+    map<int,Polynomial> powers;
+
+    for (auto &t : terms) {
+        int e = (int)t.first.size() > idx ? t.first[idx] : 0;
+        Monomial m = t.first;
+        Polynomial term;
+
+        if (e) m[idx] = 0;
+        term.add(m,t.second);
+
+        if (e) {
+            auto it = powers.find(e);
+            if (it == powers.end()) it = powers.insert(make_pair(e,value.pow(e))).first;
+            term = term*it->second;
+        }
+
+        res = res + term;
+    }
+
+    return res;
+}
+
+Polynomial Polynomial::deriv(int idx, int n) const {
+    Polynomial res;
+
+    for (auto &t : terms) {
+        int e = (int)t.first.size() > idx ? t.first[idx] : 0;
+        if (e < n) continue;
+
+        Monomial m = t.first;
+        Rational c = t.second;
+
+        for (int k=0; k<n; ++k) c *= Rational(e-k);
+        m[idx] -= n;
+
+        res.add(m,c);
+    }
+
+    return res;
+}
+
+bool Polynomial::operator==(const Polynomial &other) const {
+    return terms == other.terms;
+}
+
+string Polynomial::str(const vector<string> &symbols) const {
+    if (terms.empty()) return "0";
+
+    vector<pair<Monomial,Rational>> sorted(terms.begin(),terms.end());
+
+    // highest total degree first
+    stable_sort(sorted.begin(),sorted.end(),[](const pair<Monomial,Rational> &a, const pair<Monomial,Rational> &b) {
+        int da = 0, db = 0;
+        for (int e : a.first) da += e;
+        for (int e : b.first) db += e;
+        if (da != db) return da > db;
+        return a.first > b.first;
+    });
+
+    string res;
+
+    for (auto &t : sorted) {
+        Rational c = t.second;
+        string mono;
+
+        for (size_t n=0; n<t.first.size(); ++n) {
+            if (!t.first[n]) continue;
+            if (!mono.empty()) mono += "*";
+            mono += symbols[n];
+            if (t.first[n] > 1) mono += "^" + to_string(t.first[n]);
+        }
+
+        if (res.empty()) {
+            if (c.sign() < 0) res += "-";
+        } else {
+            res += c.sign() < 0 ? " - " : " + ";
+        }
+        if (c.sign() < 0) c = -c;
+
+        if (mono.empty()) {
+            res += c.str();
+        } else if (c == Rational(1)) {
+            res += mono;
+        } else {
+            res += c.str() + "*" + mono;
+        }
+    }
+
+    return res;
+}
+
+void Polynomial::add(const Monomial &m, const Rational &c) {
+    if (c.isZero()) return;
+
+    Monomial key = m;
+    while (!key.empty() && key.back() == 0) key.pop_back();
+
+    auto it = terms.find(key);
+
+    if (it == terms.end()) {
+        terms.insert(make_pair(key,c));
+    } else {
+        it->second += c;
+        if (it->second.isZero()) terms.erase(it);
+    }
+}
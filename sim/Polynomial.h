@@ -0,0 +1,73 @@
+// vim: set expandtab shiftwidth=4 tabstop=4:
+
+/*
+ *  sim/Polynomial.h
+ *
+ *  Copyright (C) 2017 Mario Prausa
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __POLYNOMIAL_H
+#define __POLYNOMIAL_H
+
+#include <FermatRational.h>
+#include <map>
+#include <vector>
+#include <string>
+
+typedef FermatInteger Integer;
+typedef FermatRational Rational;
+
+/*
+ *  Sparse multivariate polynomials with rational coefficients. Symbols are
+ *  referred to by their index; exponent vectors have no trailing zeros.
+ */
+class Polynomial {
+    public:
+        typedef std::vector<int> Monomial;
+    protected:
+        std::map<Monomial,Rational> terms;
+    public:
+        Polynomial();
+        Polynomial(const Rational &c);
+
+        static Polynomial symbol(int idx);
+
+        bool isZero() const;
+        bool isConstant() const;
+        Rational constant() const;
+
+        int deg(int idx) const;
+        int codeg(int idx) const;
+        Integer denominator() const;    // lcm of the coefficient denominators
+
+        Polynomial operator-() const;
+        Polynomial operator+(const Polynomial &other) const;
+        Polynomial operator-(const Polynomial &other) const;
+        Polynomial operator*(const Polynomial &other) const;
+        Polynomial operator*(const Rational &c) const;
+        Polynomial pow(int n) const;
+
+        Polynomial subst(int idx, const Polynomial &value) const;
+        Polynomial deriv(int idx, int n) const;
+
+        bool operator==(const Polynomial &other) const;
+
+        std::string str(const std::vector<std::string> &symbols) const;
+    private:
+        void add(const Monomial &m, const Rational &c);
+};
+
+#endif //__POLYNOMIAL_H
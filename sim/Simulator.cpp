@@ -0,0 +1,972 @@
+// vim: set expandtab shiftwidth=4 tabstop=4:
+
+/*
+ *  sim/Simulator.cpp
+ *
+ *  Copyright (C) 2017 Mario Prausa
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Simulator.h"
+#include <algorithm>
+#include <cctype>
+using namespace std;
+
+static string trim(const string &s) {
+    size_t b = s.find_first_not_of(" \t\r");
+    if (b == string::npos) return "";
+    size_t e = s.find_last_not_of(" \t\r");
+    return s.substr(b,e-b+1);
+}
+
+// split at separators which are not nested in brackets
+static vector<string> split(const string &s, char sep) {
+    vector<string> res;
+    string cur;
+    int depth = 0;
+
+    for (char c : s) {
+        if (c == '(' || c == '[') depth++;
+        if (c == ')' || c == ']') depth--;
+
+        if (c == sep && depth == 0) {
+            res.push_back(cur);
+            cur.clear();
+        } else {
+            cur += c;
+        }
+    }
+    res.push_back(cur);
+
+    return res;
+}
+
+static size_t findTopLevel(const string &s, const string &tok) {
+    int depth = 0;
+
+    for (size_t n=0; n<s.size(); ++n) {
+        char c = s[n];
+        if (c == '(' || c == '[') depth++;
+        if (c == ')' || c == ']') depth--;
+        if (depth == 0 && s.compare(n,tok.size(),tok) == 0) return n;
+    }
+
+    return string::npos;
+}
+
+Polynomial &Simulator::Array::at(int i, int j) {
+    if (i < 1 || i > r || j < 1 || j > c) throw SimError("array index out of range.");
+    return data[(i-1)+(j-1)*r];
+}
+
+const Polynomial &Simulator::Array::at(int i, int j) const {
+    if (i < 1 || i > r || j < 1 || j > c) throw SimError("array index out of range.");
+    return data[(i-1)+(j-1)*r];
+}
+
+Simulator::Simulator() {
+    pos = 0;
+}
+
+bool Simulator::execute(const string &line, vector<string> &out) {
+    for (auto &stmt : split(line,';')) {
+        try {
+            if (!statement(stmt,out)) return false;
+        } catch (const SimError &e) {
+            out.push_back(string(" *** ") + e.what());
+            break;
+        } catch (const domain_error &e) {
+            out.push_back(" *** can't divide by 0.");
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool Simulator::statement(string stmt, vector<string> &out) {
+    stmt = trim(stmt);
+
+    if (stmt.empty()) return true;
+    if (stmt == "&q") return false;
+
+    if (stmt.compare(0,2,"&(") == 0) {
+        if (stmt.back() != ')') throw SimError("syntax error.");
+        settings(stmt.substr(2,stmt.size()-3));
+        return true;
+    }
+
+    if (stmt[0] == '&') return true;
+
+    if (stmt[0] == '@') {
+        remove(trim(stmt.substr(1)));
+        return true;
+    }
+
+    if (stmt.compare(0,6,"Array ") == 0) {
+        declare(trim(stmt.substr(6)));
+        return true;
+    }
+
+    if (stmt.compare(0,2,"![") == 0) {
+        string name = trim(stmt.substr(2,stmt.size()-3));
+        out.push_back(printSparse(name,arrayRef(name)));
+        return true;
+    }
+
+    size_t p = findTopLevel(stmt,":=");
+
+    if (p != string::npos) {
+        assign(trim(stmt.substr(0,p)),trim(stmt.substr(p+2)));
+        return true;
+    }
+
+    Value v = evaluate(stmt);
+
+    if (v.isArray) {
+        out.push_back(print(v.array));
+    } else {
+        out.push_back(v.scalar.str(symbols));
+    }
+
+    return true;
+}
+
+void Simulator::settings(const string &str) {
+    for (auto &item : split(str,',')) {
+        size_t p = item.find('=');
+        if (p == string::npos) continue;
+
+        string key = trim(item.substr(0,p));
+        string val = trim(item.substr(p+1));
+
+        if (key != "J") continue;
+
+        if (val[0] == '-') {
+            // dropping a symbol would renumber all polynomials; it simply stays known.
+            continue;
+        }
+
+        if (scalars.count(val) || arrays.count(val)) throw SimError("symbol name is already in use.");
+        if (symbolIndex(val) < 0) symbols.push_back(val);
+    }
+}
+
+void Simulator::remove(const string &str) {
+    if (str.empty()) return;
+
+    if (str[0] == '(') {
+        for (auto &item : split(str.substr(1,str.size()-2),',')) {
+            string name = trim(item);
+            if (name.empty()) continue;
+            if (name[0] == '[') {
+                arrays.erase(trim(name.substr(1,name.size()-2)));
+            } else {
+                scalars.erase(name);
+            }
+        }
+    } else if (str[0] == '[') {
+        arrays.erase(trim(str.substr(1,str.size()-2)));
+    } else {
+        scalars.erase(str);
+    }
+}
+
+void Simulator::declare(const string &str) {
+    src = str;
+    pos = 0;
+
+    string name = ident();
+    Array a;
+
+    expect("[");
+    a.r = toInt(parseExpr());
+    a.c = accept(",") ? toInt(parseExpr()) : 1;
+    expect("]");
+
+    a.sparse = accept("Sparse");
+
+    skip();
+    if (pos != src.size()) throw SimError("syntax error.");
+    if (a.r <= 0 || a.c <= 0) throw SimError("bad array dimension.");
+
+    a.data.assign(a.r*a.c,Polynomial());
+    arrays[name] = a;
+}
+
+void Simulator::assign(const string &lhs, const string &rhs) {
+    if (lhs.empty()) throw SimError("syntax error.");
+
+    if (lhs[0] == '[') {
+        string inner = trim(lhs.substr(1,lhs.size()-2));
+        size_t p = inner.find('[');
+
+        if (p != string::npos) {
+            Array &a = arrayRef(trim(inner.substr(0,p)));
+            int r1, r2, c1, c2;
+
+            src = inner;
+            pos = p+1;
+            parseRange(r1,r2,a.r);
+            if (accept(",")) {
+                parseRange(c1,c2,a.c);
+            } else {
+                c1 = c2 = 1;
+            }
+            expect("]");
+
+            Value v = evaluate(rhs);
+            if (!v.isArray) throw SimError("array expected.");
+            if ((int)v.array.data.size() != (r2-r1+1)*(c2-c1+1)) throw SimError("array dimensions don't match.");
+
+            Array &dst = arrayRef(trim(inner.substr(0,p)));
+            for (int j=c1; j<=c2; ++j) {
+                for (int i=r1; i<=r2; ++i) {
+                    dst.at(i,j) = v.array.data[(i-r1)+(j-c1)*(r2-r1+1)];
+                }
+            }
+            return;
+        }
+
+        Value v = evaluate(rhs);
+        if (!v.isArray) throw SimError("array expected.");
+
+        auto it = arrays.find(inner);
+
+        if (v.literal) {
+            if (it == arrays.end()) {
+                arrays[inner] = v.array;
+            } else {
+                if (it->second.data.size() != v.array.data.size()) throw SimError("array dimensions don't match.");
+                it->second.data = v.array.data;
+            }
+        } else {
+            bool sparse = it != arrays.end() && it->second.sparse;
+            arrays[inner] = v.array;
+            arrays[inner].sparse = sparse;
+        }
+        return;
+    }
+
+    size_t p = lhs.find('[');
+
+    if (p != string::npos) {
+        string name = trim(lhs.substr(0,p));
+        int i, j = 1;
+
+        arrayRef(name);
+
+        src = lhs;
+        pos = p+1;
+        i = toInt(parseExpr());
+        if (accept(",")) j = toInt(parseExpr());
+        expect("]");
+
+        Polynomial val = toScalar(evaluate(rhs));
+        arrayRef(name).at(i,j) = val;
+        return;
+    }
+
+    if (symbolIndex(lhs) >= 0) throw SimError("can't assign to a symbol.");
+
+    scalars[lhs] = toScalar(evaluate(rhs));
+}
+
+string Simulator::print(const Array &a) const {
+    // rows as [..], terminated with a backtick like Fermat does
+    string res = "[";
+
+    for (int i=1; i<=a.r; ++i) {
+        if (i > 1) res += ", ";
+        res += "[";
+        for (int j=1; j<=a.c; ++j) {
+            if (j > 1) res += ", ";
+            res += a.at(i,j).str(symbols);
+        }
+        res += "]";
+    }
+    res += "]`";
+
+    return res;
+}
+
+string Simulator::printSparse(const string &name, const Array &a) const {
+    string res = "[" + name + "] := [";
+    bool firstRow = true;
+
+    for (int i=1; i<=a.r; ++i) {
+        string row;
+
+        for (int j=1; j<=a.c; ++j) {
+            if (a.at(i,j).isZero()) continue;
+            row += "[" + to_string(j) + ", " + a.at(i,j).str(symbols) + "]";
+        }
+
+        if (row.empty()) continue;
+        if (!firstRow) res += " ";
+        res += "[" + to_string(i) + ", " + row + "]";
+        firstRow = false;
+    }
+    res += "]`";
+
+    return res;
+}
+
+Simulator::Value Simulator::evaluate(const string &str) {
+    src = str;
+    pos = 0;
+
+    Value v = parseExpr();
+
+    skip();
+    if (pos != src.size()) throw SimError("syntax error.");
+
+    return v;
+}
+
+Simulator::Value Simulator::parseExpr() {
+    Value v = parseTerm();
+
+    for (;;) {
+        if (accept("+")) {
+            v = add(v,parseTerm(),false);
+        } else if (peek("-")) {
+            ++pos;
+            v = add(v,parseTerm(),true);
+        } else if (accept("_")) {
+            v = concat(v,parseTerm());
+        } else {
+            return v;
+        }
+    }
+}
+
+Simulator::Value Simulator::parseTerm() {
+    Value v = parseUnary();
+
+    for (;;) {
+        if (accept("*")) {
+            v = mul(v,parseUnary());
+        } else if (accept("/")) {
+            v = div(v,parseUnary());
+        } else if (accept("|")) {
+            Value m = parseUnary();
+            if (v.isArray || m.isArray) throw SimError("| is only supported for scalars.");
+            if (!v.scalar.isConstant() || !v.scalar.constant().isInteger()) throw SimError("| is only supported for integers.");
+
+            Integer n = toScalar(m).constant().numer();
+            if (n.isZero()) throw domain_error("division by zero");
+
+            Integer res = v.scalar.constant().numer() % n;
+            if (res.isNegative()) res += n.abs();
+            v = scalar(Polynomial(Rational(res)));
+        } else {
+            return v;
+        }
+    }
+}
+
+Simulator::Value Simulator::parseUnary() {
+    if (accept("-")) {
+        Value v = parseUnary();
+        return mul(v,scalar(Polynomial(Rational(-1))));
+    }
+    if (accept("+")) return parseUnary();
+
+    return parsePower();
+}
+
+Simulator::Value Simulator::parsePower() {
+    Value v = parsePostfix();
+
+    if (accept("^")) {
+        int n = toInt(parseUnary());
+
+        if (v.isArray) throw SimError("powers of arrays are not supported.");
+
+        if (n < 0) {
+            if (!v.scalar.isConstant()) throw SimError("division by non-constant polynomials is not supported.");
+            Rational c = v.scalar.constant();
+            if (c.isZero()) throw domain_error("division by zero");
+            return scalar(Polynomial(Rational(1)/c).pow(-n));
+        }
+
+        return scalar(v.scalar.pow(n));
+    }
+
+    return v;
+}
+
+Simulator::Value Simulator::parsePostfix() {
+    Value v = parsePrimary();
+
+    while (accept("#")) {
+        vector<pair<int,Polynomial>> repl;
+
+        expect("(");
+        do {
+            string sym = ident();
+            expect("=");
+            Polynomial val = toScalar(parseExpr());
+            int idx = symbolIndex(sym);
+
+            if (idx < 0) throw SimError("unknown symbol in substitution.");
+            repl.push_back(make_pair(idx,val));
+        } while (accept(","));
+        expect(")");
+
+        for (auto &r : repl) {
+            if (v.isArray) {
+                for (auto &p : v.array.data) p = p.subst(r.first,r.second);
+            } else {
+                v.scalar = v.scalar.subst(r.first,r.second);
+            }
+        }
+    }
+
+    return v;
+}
+
+Simulator::Value Simulator::parsePrimary() {
+    skip();
+
+    if (pos >= src.size()) throw SimError("syntax error.");
+
+    char c = src[pos];
+
+    if (isdigit(c)) {
+        size_t b = pos;
+        while (pos < src.size() && isdigit(src[pos])) ++pos;
+
+        Integer n;
+        Integer::parse(src.substr(b,pos-b),n);
+
+        return scalar(Polynomial(Rational(n)));
+    }
+
+    if (accept("(")) {
+        Value v = parseExpr();
+        expect(")");
+        return v;
+    }
+
+    if (accept("[")) {
+        if (accept("[")) {
+            Array a;
+            a.sparse = false;
+
+            if (!peek("]")) {
+                do {
+                    a.data.push_back(toScalar(parseExpr()));
+                } while (accept(","));
+            }
+            expect("]");
+            expect("]");
+
+            a.r = a.data.size();
+            a.c = 1;
+
+            Value v = array(a);
+            v.literal = true;
+            return v;
+        }
+
+        string name = ident();
+        const Array &a = arrayRef(name);
+
+        if (accept("[")) {
+            int r1, r2, c1, c2;
+
+            parseRange(r1,r2,a.r);
+            if (accept(",")) {
+                parseRange(c1,c2,a.c);
+            } else {
+                c1 = c2 = 1;
+            }
+            expect("]");
+            expect("]");
+
+            Array sub;
+            sub.r = r2-r1+1;
+            sub.c = c2-c1+1;
+            sub.sparse = false;
+
+            for (int j=c1; j<=c2; ++j) {
+                for (int i=r1; i<=r2; ++i) {
+                    sub.data.push_back(a.at(i,j));
+                }
+            }
+
+            return array(sub);
+        }
+
+        expect("]");
+
+        Value v = array(a);
+        v.array.sparse = false;
+        return v;
+    }
+
+    if (isalpha(c)) {
+        string name = ident();
+
+        static const char *functions[] = {"Numer","Denom","Deg","Codeg","Deriv","Det","Trans","Cols",
+                                          "Iszero","Colreduce","Redrowech","Chpoly",NULL};
+
+        for (int n=0; functions[n]; ++n) {
+            if (name == functions[n] && (peek("(") || peek("["))) return parseFunction(name);
+        }
+
+        if (accept("[")) {
+            const Array &a = arrayRef(name);
+            int i = toInt(parseExpr()), j = 1;
+
+            if (accept(",")) j = toInt(parseExpr());
+            expect("]");
+
+            return scalar(a.at(i,j));
+        }
+
+        int idx = symbolIndex(name);
+        if (idx >= 0) return scalar(Polynomial::symbol(idx));
+
+        auto it = scalars.find(name);
+        if (it == scalars.end()) throw SimError("undefined variable " + name + ".");
+
+        return scalar(it->second);
+    }
+
+    throw SimError("syntax error.");
+}
+
+Simulator::Value Simulator::parseFunction(const string &name) {
+    bool bracket = accept("[");
+
+    if (!bracket) expect("(");
+
+    auto arrayArg = [this,bracket]() -> string {
+        if (bracket) return ident();
+        expect("[");
+        string n = ident();
+        expect("]");
+        return n;
+    };
+
+    Value res;
+
+    if (name == "Numer" || name == "Denom") {
+        Polynomial p = toScalar(parseExpr());
+        Integer d = p.denominator();
+
+        res = scalar(name == "Denom" ? Polynomial(Rational(d)) : p*Rational(d));
+    } else if (name == "Deg" && bracket) {
+        const Array &a = arrayRef(ident());
+        res = scalar(Polynomial(Rational((long long)a.data.size())));
+    } else if (name == "Deg" || name == "Codeg") {
+        Polynomial p = toScalar(parseExpr());
+        expect(",");
+        int idx = symbolIndex(ident());
+
+        int d = idx < 0 ? 0 : (name == "Deg" ? p.deg(idx) : p.codeg(idx));
+        res = scalar(Polynomial(Rational(d)));
+    } else if (name == "Deriv") {
+        Polynomial p = toScalar(parseExpr());
+        expect(",");
+        int idx = symbolIndex(ident());
+        expect(",");
+        int n = toInt(parseExpr());
+
+        res = scalar(idx < 0 ? (n ? Polynomial() : p) : p.deriv(idx,n));
+    } else if (name == "Det") {
+        res = scalar(det(arrayRef(arrayArg())));
+    } else if (name == "Trans") {
+        res = array(transpose(arrayRef(arrayArg())));
+    } else if (name == "Cols") {
+        res = scalar(Polynomial(Rational(arrayRef(arrayArg()).c)));
+    } else if (name == "Iszero") {
+        const Array &a = arrayRef(arrayArg());
+        bool zero = true;
+
+        for (auto &p : a.data) zero = zero && p.isZero();
+        res = scalar(Polynomial(Rational(zero ? 1 : 0)));
+    } else if (name == "Redrowech") {
+        Array &a = arrayRef(arrayArg());
+        res = scalar(Polynomial(Rational(rowEchelon(a))));
+    } else if (name == "Colreduce") {
+        string aname = arrayArg();
+        Array t = transpose(arrayRef(aname));
+        Array track = identity(t.r);
+        int rank = rowEchelon(t);
+
+        // column reduction is row reduction of the transpose; redo it on [A^T | 1] for the transformation.
+        if (accept(",")) {
+            string left = arrayArg();
+            expect(",");
+            string right = arrayArg();
+
+            Array aug;
+            Array at = transpose(arrayRef(aname));
+            aug.r = at.r;
+            aug.c = at.c+at.r;
+            aug.sparse = false;
+            aug.data.assign(aug.r*aug.c,Polynomial());
+            for (int i=1; i<=at.r; ++i) {
+                for (int j=1; j<=at.c; ++j) aug.at(i,j) = at.at(i,j);
+                aug.at(i,at.c+i) = Polynomial(Rational(1));
+            }
+            rowEchelon(aug);
+            for (int i=1; i<=at.r; ++i) {
+                for (int j=1; j<=at.r; ++j) track.at(i,j) = aug.at(i,at.c+j);
+            }
+
+            arrayRef(left) = identity(arrayRef(aname).r);
+            arrayRef(right) = transpose(track);
+        }
+
+        arrayRef(aname) = transpose(t);
+        res = scalar(Polynomial(Rational(rank)));
+    } else {
+        throw SimError(name + " is not supported by fermat_sim.");
+    }
+
+    expect(bracket ? "]" : ")");
+
+    return res;
+}
+
+void Simulator::parseRange(int &from, int &to, int max) {
+    from = toInt(parseExpr());
+    to = accept("~") ? toInt(parseExpr()) : from;
+
+    if (from < 1 || to > max || to < from) throw SimError("array index out of range.");
+}
+
+Simulator::Array &Simulator::arrayRef(const string &name) {
+    auto it = arrays.find(name);
+    if (it == arrays.end()) throw SimError("undefined array " + name + ".");
+    return it->second;
+}
+
+int Simulator::symbolIndex(const string &name) const {
+    auto it = find(symbols.begin(),symbols.end(),name);
+    return it == symbols.end() ? -1 : (int)(it-symbols.begin());
+}
+
+int Simulator::toInt(const Value &v) const {
+    Polynomial p = toScalar(v);
+
+    if (!p.isConstant() || !p.constant().isInteger() || !p.constant().numer().fitsInt()) {
+        throw SimError("integer expected.");
+    }
+
+    return (int)p.constant().numer().toInt();
+}
+
+Polynomial Simulator::toScalar(const Value &v) const {
+    if (v.isArray) throw SimError("scalar expected.");
+    return v.scalar;
+}
+
+Simulator::Value Simulator::scalar(const Polynomial &p) {
+    Value v;
+    v.isArray = false;
+    v.literal = false;
+    v.scalar = p;
+    return v;
+}
+
+Simulator::Value Simulator::array(const Array &a) {
+    Value v;
+    v.isArray = true;
+    v.literal = false;
+    v.array = a;
+    return v;
+}
+
+Simulator::Value Simulator::add(const Value &a, const Value &b, bool subtract) {
+    if (a.isArray != b.isArray) throw SimError("can't add arrays and scalars.");
+
+    if (!a.isArray) return scalar(subtract ? a.scalar-b.scalar : a.scalar+b.scalar);
+
+    if (a.array.r != b.array.r || a.array.c != b.array.c) throw SimError("array dimensions don't match.");
+
+    Value res = a;
+    res.literal = false;
+    for (size_t n=0; n<res.array.data.size(); ++n) {
+        res.array.data[n] = subtract ? a.array.data[n]-b.array.data[n] : a.array.data[n]+b.array.data[n];
+    }
+
+    return res;
+}
+
+Simulator::Value Simulator::mul(const Value &a, const Value &b) {
+    if (!a.isArray && !b.isArray) return scalar(a.scalar*b.scalar);
+
+    if (!a.isArray || !b.isArray) {
+        Value res = a.isArray ? a : b;
+        const Polynomial &f = a.isArray ? b.scalar : a.scalar;
+
+        res.literal = false;
+        for (auto &p : res.array.data) p = p*f;
+        return res;
+    }
+
+    const Array &x = a.array, &y = b.array;
+
+    if (x.c != y.r) throw SimError("array dimensions don't match.");
+
+    Array z;
+    z.r = x.r;
+    z.c = y.c;
+    z.sparse = false;
+    z.data.assign(z.r*z.c,Polynomial());
+
+    for (int j=1; j<=z.c; ++j) {
+        for (int k=1; k<=x.c; ++k) {
+            const Polynomial &ykj = y.at(k,j);
+            if (ykj.isZero()) continue;
+            for (int i=1; i<=z.r; ++i) {
+                const Polynomial &xik = x.at(i,k);
+                if (!xik.isZero()) z.at(i,j) = z.at(i,j) + xik*ykj;
+            }
+        }
+    }
+
+    return array(z);
+}
+
+Simulator::Value Simulator::div(const Value &a, const Value &b) {
+    if (b.isArray) {
+        Array inv = inverse(b.array);
+        return mul(a,array(inv));
+    }
+
+    if (!b.scalar.isConstant()) throw SimError("division by non-constant polynomials is not supported.");
+    if (b.scalar.isZero()) throw domain_error("division by zero");
+
+    return mul(a,scalar(Polynomial(Rational(1)/b.scalar.constant())));
+}
+
+Simulator::Value Simulator::concat(const Value &a, const Value &b) {
+    if (!a.isArray || !b.isArray) throw SimError("array expected.");
+
+    const Array &x = a.array, &y = b.array;
+    Array z;
+    z.sparse = false;
+
+    if (x.r == 1 && x.c == 1 && y.r == 1 && y.c == 1) {
+        z.r = 1;
+        z.c = 2;
+        z.data = {x.data[0],y.data[0]};
+        return array(z);
+    }
+
+    if (x.c != y.c) throw SimError("array dimensions don't match.");
+
+    z.r = x.r+y.r;
+    z.c = x.c;
+    z.data.assign(z.r*z.c,Polynomial());
+
+    for (int j=1; j<=z.c; ++j) {
+        for (int i=1; i<=x.r; ++i) z.at(i,j) = x.at(i,j);
+        for (int i=1; i<=y.r; ++i) z.at(x.r+i,j) = y.at(i,j);
+    }
+
+    return array(z);
+}
+
+bool Simulator::numeric(const Array &a) {
+    for (auto &p : a.data) {
+        if (!p.isConstant()) return false;
+    }
+    return true;
+}
+
+Simulator::Array Simulator::identity(int n) {
+    Array a;
+
+    a.r = a.c = n;
+    a.sparse = false;
+    a.data.assign(n*n,Polynomial());
+    for (int i=1; i<=n; ++i) a.at(i,i) = Polynomial(Rational(1));
+
+    return a;
+}
+
+Simulator::Array Simulator::transpose(const Array &a) {
+    Array t;
+
+    t.r = a.c;
+    t.c = a.r;
+    t.sparse = false;
+    t.data.assign(t.r*t.c,Polynomial());
+
+    for (int i=1; i<=a.r; ++i) {
+        for (int j=1; j<=a.c; ++j) t.at(j,i) = a.at(i,j);
+    }
+
+    return t;
+}
+
+Simulator::Array Simulator::inverse(const Array &a) {
+    if (a.r != a.c) throw SimError("matrix is not square.");
+    if (!numeric(a)) throw SimError("symbolic inverses are not supported by fermat_sim.");
+
+    int n = a.r;
+    Array aug;
+
+    aug.r = n;
+    aug.c = 2*n;
+    aug.sparse = false;
+    aug.data.assign(aug.r*aug.c,Polynomial());
+
+    for (int i=1; i<=n; ++i) {
+        for (int j=1; j<=n; ++j) aug.at(i,j) = a.at(i,j);
+        aug.at(i,n+i) = Polynomial(Rational(1));
+    }
+
+    if (rowEchelon(aug) < n || aug.at(n,n).isZero()) throw domain_error("singular matrix");
+
+    Array inv;
+    inv.r = inv.c = n;
+    inv.sparse = false;
+    inv.data.assign(n*n,Polynomial());
+
+    for (int i=1; i<=n; ++i) {
+        for (int j=1; j<=n; ++j) inv.at(i,j) = aug.at(i,n+j);
+    }
+
+    return inv;
+}
+
+Polynomial Simulator::det(const Array &a) {
+    if (a.r != a.c) throw SimError("matrix is not square.");
+
+    int n = a.r;
+
+    if (!numeric(a)) {
+        if (n == 1) return a.at(1,1);
+        if (n > 8) throw SimError("symbolic determinants above 8x8 are not supported by fermat_sim.");
+
+        // Laplace expansion along the first column
+        Polynomial res;
+        for (int i=1; i<=n; ++i) {
+            if (a.at(i,1).isZero()) continue;
+
+            Array minor;
+            minor.r = minor.c = n-1;
+            minor.sparse = false;
+            for (int j=2; j<=n; ++j) {
+                for (int k=1; k<=n; ++k) {
+                    if (k != i) minor.data.push_back(a.at(k,j));
+                }
+            }
+
+            Polynomial term = a.at(i,1)*det(minor);
+            res = (i%2) ? res+term : res-term;
+        }
+        return res;
+    }
+
+    vector<Rational> m(n*n);
+    for (int i=0; i<n*n; ++i) m[i] = a.data[i].constant();
+
+    Rational d(1);
+
+    for (int k=0; k<n; ++k) {
+        int p = k;
+        while (p < n && m[p+k*n].isZero()) ++p;
+        if (p == n) return Polynomial();
+
+        if (p != k) {
+            for (int j=0; j<n; ++j) swap(m[p+j*n],m[k+j*n]);
+            d = -d;
+        }
+
+        Rational pivot = m[k+k*n];
+        d *= pivot;
+
+        for (int i=k+1; i<n; ++i) {
+            if (m[i+k*n].isZero()) continue;
+            Rational f = m[i+k*n]/pivot;
+            for (int j=k; j<n; ++j) m[i+j*n] -= f*m[k+j*n];
+        }
+    }
+
+    return Polynomial(d);
+}
+
+int Simulator::rowEchelon(Array &a) {
+    if (!numeric(a)) throw SimError("symbolic row reduction is not supported by fermat_sim.");
+
+    int rank = 0;
+
+    for (int j=1; j<=a.c && rank<a.r; ++j) {
+        int p = rank+1;
+        while (p <= a.r && a.at(p,j).isZero()) ++p;
+        if (p > a.r) continue;
+
+        ++rank;
+        if (p != rank) {
+            for (int k=1; k<=a.c; ++k) swap(a.at(p,k),a.at(rank,k));
+        }
+
+        Rational inv = Rational(1)/a.at(rank,j).constant();
+        for (int k=j; k<=a.c; ++k) a.at(rank,k) = a.at(rank,k)*inv;
+
+        for (int i=1; i<=a.r; ++i) {
+            if (i == rank || a.at(i,j).isZero()) continue;
+            Rational f = a.at(i,j).constant();
+            for (int k=j; k<=a.c; ++k) {
+                a.at(i,k) = a.at(i,k) - a.at(rank,k)*f;
+            }
+        }
+    }
+
+    return rank;
+}
+
+void Simulator::skip() {
+    while (pos < src.size() && isspace(src[pos])) ++pos;
+}
+
+bool Simulator::peek(const string &tok) {
+    skip();
+    return src.compare(pos,tok.size(),tok) == 0;
+}
+
+bool Simulator::accept(const string &tok) {
+    if (!peek(tok)) return false;
+    pos += tok.size();
+    return true;
+}
+
+void Simulator::expect(const string &tok) {
+    if (!accept(tok)) throw SimError("syntax error, expected '" + tok + "'.");
+}
+
+string Simulator::ident() {
+    skip();
+
+    size_t b = pos;
+
+    if (pos < src.size() && (isalpha(src[pos]) || src[pos] == '_')) {
+        while (pos < src.size() && (isalnum(src[pos]) || src[pos] == '_')) ++pos;
+    }
+
+    if (b == pos) throw SimError("syntax error, name expected.");
+
+    return src.substr(b,pos-b);
+}
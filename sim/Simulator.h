@@ -0,0 +1,120 @@
+// vim: set expandtab shiftwidth=4 tabstop=4:
+
+/*
+ *  sim/Simulator.h
+ *
+ *  Copyright (C) 2017 Mario Prausa
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SIMULATOR_H
+#define __SIMULATOR_H
+
+#include "Polynomial.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <stdexcept>
+
+class SimError : public std::runtime_error {
+    public:
+        SimError(const std::string &msg) : std::runtime_error(msg) {}
+};
+
+/*
+ *  Interpreter for the subset of the Fermat language libFermat emits.
+ *  Scalars are polynomials over the rationals in the symbols added with
+ *  &(J=...); division is only supported by constants. Arrays are stored
+ *  dense and column major, like Fermat does.
+ */
+class Simulator {
+    protected:
+        struct Array {
+            int r;
+            int c;
+            bool sparse;
+            std::vector<Polynomial> data;
+
+            Polynomial &at(int i, int j);
+            const Polynomial &at(int i, int j) const;
+        };
+
+        struct Value {
+            bool isArray;
+            bool literal;       // [[...]] list, shaped by the assignment
+            Polynomial scalar;
+            Array array;
+        };
+
+        std::vector<std::string> symbols;
+        std::map<std::string,Polynomial> scalars;
+        std::map<std::string,Array> arrays;
+
+        std::string src;
+        size_t pos;
+    public:
+        Simulator();
+
+        // executes one input line, returns false if Fermat should quit
+        bool execute(const std::string &line, std::vector<std::string> &out);
+    private:
+        bool statement(std::string stmt, std::vector<std::string> &out);
+
+        void settings(const std::string &str);
+        void remove(const std::string &str);
+        void declare(const std::string &str);
+        void assign(const std::string &lhs, const std::string &rhs);
+
+        std::string print(const Array &a) const;
+        std::string printSparse(const std::string &name, const Array &a) const;
+
+        Value evaluate(const std::string &str);
+        Value parseExpr();
+        Value parseTerm();
+        Value parseUnary();
+        Value parsePower();
+        Value parsePostfix();
+        Value parsePrimary();
+        Value parseFunction(const std::string &name);
+        void parseRange(int &from, int &to, int max);
+
+        Array &arrayRef(const std::string &name);
+        int symbolIndex(const std::string &name) const;
+        int toInt(const Value &v) const;
+        Polynomial toScalar(const Value &v) const;
+
+        static Value scalar(const Polynomial &p);
+        static Value array(const Array &a);
+
+        Value add(const Value &a, const Value &b, bool subtract);
+        Value mul(const Value &a, const Value &b);
+        Value div(const Value &a, const Value &b);
+        Value concat(const Value &a, const Value &b);
+
+        static bool numeric(const Array &a);
+        static Array identity(int n);
+        static Array transpose(const Array &a);
+        static Array inverse(const Array &a);
+        static Polynomial det(const Array &a);
+        static int rowEchelon(Array &a);
+
+        void skip();
+        bool peek(const std::string &tok);
+        bool accept(const std::string &tok);
+        void expect(const std::string &tok);
+        std::string ident();
+};
+
+#endif //__SIMULATOR_H
@@ -0,0 +1,107 @@
+// vim: set expandtab shiftwidth=4 tabstop=4:
+
+/*
+ *  sim/fermat_sim.cpp
+ *
+ *  Copyright (C) 2017 Mario Prausa
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ *  Stand-in for fer64 speaking the prompt protocol libFermat expects: every
+ *  input line is answered with its output (if any) followed by a ">" prompt
+ *  line, errors are reported as " *** ..." lines.
+ */
+
+#include "Simulator.h"
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+using namespace std;
+
+static void usage(string progname) {
+    cerr << "Usage: " << progname << " OPTIONS" << endl << endl;
+    cerr << left;
+
+    cerr << "OPTIONS:" << endl;
+    cerr << setw(60) << "   --latency <microseconds>"                                << "Artificial delay for every command." << endl;
+    cerr << setw(60) << "   --pad <bytes>"                                           << "Append <bytes> of whitespace to every printed value." << endl;
+    cerr << setw(60) << "   --help"                                                  << "this help text." << endl;
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    long latency = 0;
+    long pad = 0;
+
+    for (int n=1; n<argc; ++n) {
+        if (string(argv[n]) == "--latency") {
+            if (++n == argc) usage(argv[0]);
+            latency = atol(argv[n]);
+        } else if (string(argv[n]) == "--pad") {
+            if (++n == argc) usage(argv[0]);
+            pad = atol(argv[n]);
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    ios::sync_with_stdio(false);
+
+    Simulator sim;
+    string line;
+    string buffer = "fermat_sim, Fermat protocol simulator\n\n";
+    vector<string> out;
+    string padding(pad > 0 ? pad : 0,' ');
+
+    while (getline(cin,line)) {
+        bool running = true;
+
+        if (line.find_first_not_of(" \t\r") != string::npos) {
+            if (latency > 0) usleep(latency);
+
+            out.clear();
+            running = sim.execute(line,out);
+
+            for (auto &o : out) {
+                buffer += o;
+                buffer += '\n';
+                if (pad > 0) {
+                    buffer += padding;
+                    buffer += '\n';
+                }
+            }
+        }
+
+        if (!running) break;
+
+        buffer += ">\n";
+
+        // only flush once all pipelined input is processed
+        if (cin.rdbuf()->in_avail() <= 0) {
+            fwrite(buffer.data(),1,buffer.size(),stdout);
+            fflush(stdout);
+            buffer.clear();
+        }
+    }
+
+    fwrite(buffer.data(),1,buffer.size(),stdout);
+    fflush(stdout);
+
+    return 0;
+}
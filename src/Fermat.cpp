@@ -22,16 +22,32 @@
 #include <Fermat.h>
 #include <FermatException.h>
 #include <FermatExpression.h>
+#include <FermatResponse.h>
 #include <iostream>
 #include <sstream>
+#include <fstream>
 #include <stdexcept>
+#include <exception>
+#include <algorithm>
+#include <cstdlib>
 
 using namespace std;
-using namespace redi;
 
-Fermat::Fermat(string path, bool verbose) {
+Fermat::Fermat(string path, bool verbose, size_t bufsize) : strm(bufsize) {
     string str;
     serial = 1;
+    batching = false;
+    stopping = false;
+    gcThreshold = 256;
+    instrumented = false;
+    tracing = false;
+    timeout = chrono::milliseconds::zero();
+    sessionDeadline = TimePoint::max();
+    versions = 0;
+    restartVersion = 0;
+    memoCapacity = 0;
+    scratch = false;
+    memoHits = memoMisses = 0;
 
     if (path[0] != '/' && path.find('/') != string::npos && path[0] != '.') { 
         path = "./" + path;     // fermat won't start if path is relative and doesn't start with '.'
@@ -40,11 +56,10 @@ Fermat::Fermat(string path, bool verbose) {
     _path = path;
     this->verbose = verbose;
 
-    strm.open(path,pstream::pstdin|pstream::pstdout);
-   
-    strm << "&(t=0); &(_t=0); &(_s=0); &(U=1)" << endl << endl; 
+    strm.open(path);
+    strm.write("&(t=0); &(_t=0); &(_s=0); &(U=1)");
 
-    while(getline(strm,str)) {
+    while(strm.getline(str)) {
         if (str == ">") break;
     }
 
@@ -54,6 +69,24 @@ Fermat::Fermat(string path, bool verbose) {
 }
 
 Fermat::~Fermat() {
+    if (worker.joinable()) {
+        {
+            lock_guard<mutex> lock(mtx);
+            stopping = true;
+        }
+        cv.notify_all();
+        worker.join();
+    }
+
+    if (batching) {
+        try {
+            submit();
+        } catch (const FermatException &) {}
+    }
+
+    garbage.clear();    // the process quits anyway
+    timeout = chrono::milliseconds::zero();
+    sessionDeadline = TimePoint::max();
     (*this)("&q");
 }
 
@@ -61,7 +94,7 @@ string Fermat::path() const {
     return _path;
 }
 
-pstream &Fermat::stream() {
+FermatPipe &Fermat::pipe() {
     return strm;
 }
 
@@ -73,67 +106,901 @@ void Fermat::dropSymbol(string sym) {
     (*this)("&(J=-"+sym+")");
 }
 
-string Fermat::getUnique() {
+// symbols are also added and dropped by raw &(J=x) and &(J=-x) commands
+void Fermat::trackSymbols(const string &in) {
+    for (size_t pos = in.find("&(J="); pos != string::npos; pos = in.find("&(J=",pos)) {
+        pos += 4;
+
+        bool drop = pos < in.size() && in[pos] == '-';
+        if (drop) ++pos;
+
+        size_t end = in.find_first_of("), \t;",pos);
+        string sym = in.substr(pos,end == string::npos ? string::npos : end-pos);
+
+        if (sym.empty()) continue;
+
+        lock_guard<mutex> lock(mtx);
+        auto it = find(symbols.begin(),symbols.end(),sym);
+
+        if (drop) {
+            if (it != symbols.end()) symbols.erase(it);
+        } else if (it == symbols.end()) {
+            symbols.push_back(sym);
+        }
+    }
+}
+
+vector<string> Fermat::symbolNames() const {
+    lock_guard<mutex> lock(mtx);
+    return symbols;
+}
+
+string Fermat::getUnique(bool array) {
+    lock_guard<mutex> lock(mtx);
+    vector<string> &names = freeNames[array?1:0];
     string str;
-    int num = serial++;
-    char cstr[2];
-    cstr[1] = 0;
 
-    for (int n=0;n<9; ++n) {
-        int digit = num%62;
-        num /= 62;
-        cstr[0] = (char)(digit<10?digit+'0':(digit<36?digit-10+'a':digit-36+'A'));
+    if (!names.empty()) {
+        str = move(names.back());
+        names.pop_back();
+    } else {
+        static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+        char cstr[10];
+        int num = serial++;
 
-        str = cstr + str;
+        cstr[0] = 't';
+        for (int n=9; n>0; --n) {
+            cstr[n] = digits[num%62];
+            num /= 62;
+        }
+
+        str.assign(cstr,10);
     }
 
-    str = "t" + str;
+    live[array?1:0].insert(str);
 
     return str;
 }
 
 string Fermat::operator() (string in) {
-    bool first=true;
+    return execute(move(in),false,NULL,deadlineAfter(timeout));
+}
+
+string Fermat::operator() (string in, chrono::milliseconds timeout) {
+    return execute(move(in),false,NULL,deadlineAfter(timeout));
+}
+
+string Fermat::stripped(string in) {
+    return execute(move(in),true,NULL,deadlineAfter(timeout));
+}
+
+vector<string> Fermat::stripped(const vector<string> &in) {
+    return sequence(in,true);
+}
+
+// the commands back to back, led by the pending deletions; the first error
+// is rethrown once all responses are read
+vector<string> Fermat::sequence(const vector<string> &in, bool strip) {
+    vector<string> all, out;
+    vector<exception_ptr> errors;
+
+    flush();    // the queue has to go first
+
+    string gc = garbageCommand();
+    if (!gc.empty()) all.push_back(gc);
+    all.insert(all.end(),in.begin(),in.end());
+
+    pipeline(all,strip,out,errors);
+
+    if (!gc.empty()) {
+        out.erase(out.begin());
+        errors.erase(errors.begin());
+    }
+
+    for (auto &e : errors) {
+        if (e) rethrow_exception(e);
+    }
+
+    return out;
+}
+
+void Fermat::stream(string in, FermatResponse::Sink &sink) {
+    execute(move(in),true,&sink,deadlineAfter(timeout));
+}
+
+void Fermat::setTimeout(chrono::milliseconds timeout) {
+    this->timeout = timeout;
+}
+
+void Fermat::setDeadline(TimePoint deadline) {
+    sessionDeadline = deadline;
+}
+
+namespace {
+    // outside the names handed out by getUnique()
+    const string scratchName = "tscratch";
+}
+
+bool Fermat::isZero(const string &expr) {
+    if (!scratch) {
+        // read back, so the flag is only set once the array exists, even
+        // in batch mode; all three are answered before an error is rethrown
+        stripped(vector<string>{"&(U=0)","Array "+scratchName+"[1]","&(U=1)"});
+        scratch = true;
+    }
+
+    return stripped(scratchName+"[1]:="+expr+"; Iszero["+scratchName+"]") == "1";
+}
+
+uint64_t Fermat::newVersion() {
+    return ++versions;
+}
+
+bool Fermat::isCurrent(uint64_t version) const {
+    return version > restartVersion;
+}
+
+void Fermat::memoize(size_t capacity) {
+    memoCapacity = capacity;
+    if (!capacity) clearMemo();
+}
+
+void Fermat::clearMemo() {
+    vector<MemoEntry> entries;
+
+    {
+        lock_guard<mutex> lock(memoMtx);
+
+        for (auto &entry : memo) entries.push_back(move(entry.second));
+        memo.clear();
+        memoOrder.clear();
+    }
+
+    for (auto &entry : entries) release(entry.name,entry.array);
+}
+
+Fermat::MemoStats Fermat::memoStats() {
+    lock_guard<mutex> lock(memoMtx);
+    MemoStats stats;
+
+    stats.hits = memoHits;
+    stats.misses = memoMisses;
+    stats.entries = memo.size();
+
+    return stats;
+}
+
+bool Fermat::memoizing() const {
+    return memoCapacity && !batching;
+}
+
+bool Fermat::memoFind(const string &key, string &name, int &rows, int &cols) {
+    lock_guard<mutex> lock(memoMtx);
+    auto it = memo.find(key);
+
+    if (it == memo.end()) {
+        memoMisses++;
+        return false;
+    }
+
+    memoHits++;
+    name = it->second.name;
+    rows = it->second.rows;
+    cols = it->second.cols;
+
+    return true;
+}
+
+void Fermat::memoAdd(const string &key, const string &name, bool array, int rows, int cols) {
+    vector<MemoEntry> evicted;
+
+    {
+        lock_guard<mutex> lock(memoMtx);
+
+        if (memo.count(key)) {
+            evicted.push_back(MemoEntry{name,array,rows,cols});
+        } else {
+            memo[key] = MemoEntry{name,array,rows,cols};
+            memoOrder.push_back(key);
+        }
+
+        while (memo.size() > memoCapacity) {
+            auto it = memo.find(memoOrder.front());
+            evicted.push_back(move(it->second));
+            memo.erase(it);
+            memoOrder.pop_front();
+        }
+    }
+
+    for (auto &entry : evicted) release(entry.name,entry.array);
+}
 
-    string out="";
+Fermat::TimePoint Fermat::deadlineAfter(chrono::milliseconds timeout) const {
+    if (timeout <= chrono::milliseconds::zero()) return sessionDeadline;
+
+    return min(sessionDeadline,chrono::steady_clock::now()+timeout);
+}
+
+// a command timed out: the child is gone for good, start over with the same symbols.
+void Fermat::respawn() {
     string str;
-    strm << in << endl << endl; 
+
+    strm.kill();
+    strm.setDeadline(TimePoint::max());
+    restartVersion = versions.load();
+    scratch = false;
+
+    if (!strm.open(_path)) throw invalid_argument("cannot restart Fermat");
+
+    strm.write("&(t=0); &(_t=0); &(_s=0); &(U=1)");
+
+    while(strm.getline(str)) {
+        if (str == ">") break;
+    }
+
+    {
+        lock_guard<mutex> lock(mtx);
+        lock_guard<mutex> memoLock(memoMtx);
+
+        garbage.clear();
+
+        // the kept results are gone with the process
+        for (auto &entry : memo) {
+            freeNames[entry.second.array?1:0].push_back(entry.second.name);
+            live[entry.second.array?1:0].erase(entry.second.name);
+        }
+        memo.clear();
+        memoOrder.clear();
+    }
+
+    vector<string> in;
+
+    for (auto &sym : symbolNames()) in.push_back("&(J="+sym+")");
+
+    if (in.empty()) return;
+
+    strm.write(in.data(),in.size());
+
+    for (auto &cmd : in) {
+        try {
+            receive(cmd);
+        } catch (const FermatException &) {}
+    }
+}
+
+string Fermat::execute(string in, bool strip, FermatResponse::Sink *sink, TimePoint deadline) {
+    trackSymbols(in);
+
+    if (batching && (strip || sink)) {
+        flush();    // the response is read: the queue has to go first
+    } else if (batching) {
+        string gc = garbageCommand();
+        if (!gc.empty()) queue.push_back(Queued{gc,false});
+
+        queue.push_back(Queued{in,true});
+        return "";
+    }
+
+    if (worker.joinable()) return enqueue(move(in),strip,sink,deadline).get();
+
+    string gc = garbageCommand();
+    TimePoint start = stamp();
+
+    strm.setDeadline(deadline);
+
+    if (gc.empty()) {
+        strm.write(in);
+    } else {
+        // pending deletions are written together with the command and cost no extra round trip.
+        string cmds[2] = {gc,in};
+        strm.write(cmds,2);
+
+        if (verbose) cout << "<< " << gc << endl;
+
+        try {
+            receive(gc,start);
+        } catch (const FermatTimeout &) {
+            throw;
+        } catch (const FermatException &) {}
+    }
 
     if (verbose) cout << "<< " << in << endl;
 
-    while(getline(strm,str)) {
-        if (str == "") continue;
-        if (first) {
-            first = false;
-            if (str[0] == '>') {
-                str.erase(0,1);
+    return receive(in,start,strip,sink);
+}
+
+void Fermat::release(const string &name, bool array) {
+    size_t n;
+
+    {
+        lock_guard<mutex> lock(mtx);
+
+        garbage.push_back(array ? "["+name+"]" : name);
+        n = garbage.size();
+
+        // the deletion is sent before any command that could reuse the name.
+        freeNames[array?1:0].push_back(name);
+        live[array?1:0].erase(name);
+        if (array) vectors.erase(name);
+    }
+
+    if (n >= gcThreshold) {
+        try {
+            collect();
+        } catch (const FermatException &) {}   // called from destructors
+    }
+}
+
+void Fermat::collect() {
+    string gc = garbageCommand();
+
+    if (!gc.empty()) (*this)(gc);
+}
+
+void Fermat::setCollectThreshold(size_t n) {
+    gcThreshold = n;
+}
+
+string Fermat::garbageCommand() {
+    lock_guard<mutex> lock(mtx);
+
+    if (garbage.empty()) return "";
+
+    string cmd = "@(";
+
+    for (size_t i=0; i<garbage.size(); ++i) {
+        if (i) cmd += ",";
+        cmd += garbage[i];
+    }
+    cmd += ")";
+
+    garbage.clear();
+
+    return cmd;
+}
+
+namespace {
+    // writes the whitespace-free array text to the checkpoint file
+    class FileSink : public FermatResponse::Sink {
+        public:
+            FileSink(ostream &out) : out(out) {}
+
+            void put(const char *data, size_t len) {
+                out.write(data,len);
             }
+        private:
+            ostream &out;
+    };
+
+    string scalarValue(string str) {
+        size_t pos = str.find(";or");
+        if (pos != string::npos) str.erase(pos);
+        return str;
+    }
+}
+
+void Fermat::markVector(const string &name) {
+    lock_guard<mutex> lock(mtx);
+    vectors.insert(name);
+}
+
+bool Fermat::isVector(const string &name) const {
+    lock_guard<mutex> lock(mtx);
+    return vectors.count(name) > 0;
+}
+
+void Fermat::checkpoint(const string &file) {
+    flush();
+    clearMemo();
+    collect();
+
+    ofstream out(file.c_str());
+    if (!out) throw invalid_argument("cannot open "+file);
+
+    vector<string> names[2];
+    vector<string> freed[2];
+    int counter;
+
+    {
+        lock_guard<mutex> lock(mtx);
+
+        for (int k=0; k<2; ++k) {
+            names[k].assign(live[k].begin(),live[k].end());
+            freed[k] = freeNames[k];
         }
-        if (str == ">") break;
-        if (verbose) cout << ">> " << str << endl;
-        out += str;
+        counter = serial;
+    }
+
+    out << "fermat-checkpoint 1" << endl;
+    out << "serial " << counter << endl;
+
+    for (auto &sym : symbolNames()) out << "symbol " << sym << endl;
+
+    for (int k=0; k<2; ++k) {
+        for (auto &name : freed[k]) out << "free " << k << " " << name << endl;
+    }
+
+    vector<string> in, res;
+    vector<exception_ptr> errors;
+
+    // names which were handed out but never assigned fail to print and are skipped.
+    pipeline(names[0],true,res,errors);
+
+    for (size_t i=0; i<names[0].size(); ++i) {
+        if (!errors[i]) out << "scalar " << names[0][i] << " " << scalarValue(res[i]) << endl;
+    }
+
+    for (auto &name : names[1]) {
+        in.push_back("Cols["+name+"]");
+        in.push_back("Deg["+name+"]");
+    }
+
+    pipeline(in,true,res,errors);
+
+    for (size_t i=0; i<names[1].size(); ++i) {
+        if (errors[2*i] || errors[2*i+1]) continue;
+
+        int c = atoi(res[2*i].c_str());
+        int n = atoi(res[2*i+1].c_str());
+
+        if (c <= 0 || n <= 0) continue;
+
+        FileSink sink(out);
+
+        // a vector is written as n x -1
+        if (isVector(names[1][i])) {
+            out << "array " << names[1][i] << " " << n << " " << -1 << " ";
+        } else {
+            out << "array " << names[1][i] << " " << n/c << " " << c << " ";
+        }
+        stream("["+names[1][i]+"]",sink);
+        out << endl;
+    }
+
+    if (!out) throw invalid_argument("cannot write "+file);
+}
+
+void Fermat::restore(const string &file) {
+    ifstream inp(file.c_str());
+    string line, key;
+
+    if (!inp) throw invalid_argument("cannot open "+file);
+
+    if (!getline(inp,line) || line != "fermat-checkpoint 1") {
+        throw invalid_argument(file+" is not a Fermat checkpoint");
+    }
+
+    flush();
+    clearMemo();
+    collect();
+
+    {
+        lock_guard<mutex> lock(mtx);
+
+        if (!live[0].empty() || !live[1].empty()) {
+            throw invalid_argument("restore needs a session without live variables");
+        }
+    }
+
+    vector<string> in, freed[2], scalars;
+    int counter = serial;
+    bool settled = false;
+
+    // symbols, scalars and the naming state come first and go in one batch.
+    auto settle = [&]() {
+        if (settled) return;
+        settled = true;
+
+        {
+            lock_guard<mutex> lock(mtx);
+
+            serial = counter;
+            freeNames[0].swap(freed[0]);
+            freeNames[1].swap(freed[1]);
+            live[0].insert(scalars.begin(),scalars.end());
+        }
+
+        // bulk assignments without echo, as everywhere else
+        if (!scalars.empty()) {
+            in.insert(in.begin(),"&(U=0)");
+            in.push_back("&(U=1)");
+        }
+
+        submit(in);
+    };
+
+    while (getline(inp,line)) {
+        stringstream strm(line);
+
+        key.clear();
+        strm >> key;
+
+        if (key == "serial") {
+            strm >> counter;
+        } else if (key == "symbol") {
+            string sym;
+            strm >> sym;
+            in.push_back("&(J="+sym+")");   // recorded when it is sent
+        } else if (key == "free") {
+            int k;
+            string name;
+            strm >> k >> name;
+            freed[k?1:0].push_back(name);
+        } else if (key == "scalar") {
+            string name, value;
+            strm >> name >> value;
+            in.push_back(name+":="+value);
+            scalars.push_back(name);
+        } else if (key == "array") {
+            string name, value;
+            int r, c;
+            strm >> name >> r >> c >> value;
+
+            settle();
+
+            // the entries are listed row by row, Fermat fills column by column
+            value.erase(remove_if(value.begin(),value.end(),[](char ch) {
+                return ch == '[' || ch == ']' || ch == '`';
+            }),value.end());
+
+            stringstream decl;
+
+            if (c == -1) {
+                decl << "Array " << name << "[" << r << "]";
+
+                {
+                    lock_guard<mutex> lock(mtx);
+                    live[1].insert(name);
+                    vectors.insert(name);
+                }
+
+                submit({"&(U=0)", decl.str(), "["+name+"] := [["+value+"]]", "&(U=1)"});
+                continue;
+            }
+
+            string tmp = getUnique(true);
+
+            decl << "Array " << tmp << "[" << c << "," << r << "]";
+
+            {
+                lock_guard<mutex> lock(mtx);
+                live[1].insert(name);
+            }
+
+            submit({"&(U=0)", decl.str(), "&(U=1)", "["+tmp+"] := [["+value+"]]", "["+name+"] := Trans["+tmp+"]"});
+            release(tmp,true);
+        } else if (!key.empty()) {
+            throw invalid_argument(file+": unknown entry "+key);
+        }
+    }
+
+    settle();
+}
+
+void Fermat::batch() {
+    batching = true;
+}
+
+vector<string> Fermat::submit() {
+    vector<exception_ptr> errors;
+    vector<string> out = submit(errors);
+
+    for (auto &e : errors) {
+        if (e) rethrow_exception(e);
+    }
+
+    return out;
+}
+
+vector<string> Fermat::submit(vector<exception_ptr> &errors) {
+    vector<string> out;
+
+    flush();
+    batching = false;
+
+    out.swap(drained);
+    errors.clear();
+    errors.swap(drainedErrors);
+
+    return out;
+}
+
+vector<string> Fermat::submit(const vector<string> &in) {
+    if (in.empty()) {
+        flush();
+        return vector<string>();
+    }
+
+    return sequence(in,false);
+}
+
+// sends the batch queue. The responses to the caller's commands, errors
+// included, are kept for submit(); those to deletions are dropped.
+void Fermat::flush() {
+    if (queue.empty()) return;
+
+    vector<Queued> queued;
+    vector<string> in, out;
+    vector<exception_ptr> errors;
+
+    queued.swap(queue);
+
+    string gc = garbageCommand();
+    if (!gc.empty()) queued.push_back(Queued{gc,false});
+
+    in.reserve(queued.size());
+    for (auto &q : queued) in.push_back(q.cmd);
+
+    pipeline(in,false,out,errors);
+
+    for (size_t n=0; n<queued.size(); ++n) {
+        if (!queued[n].own) continue;
+
+        drained.push_back(move(out[n]));
+        drainedErrors.push_back(errors[n]);
+    }
+}
+
+void Fermat::pipeline(const vector<string> &in, bool strip, vector<string> &out, vector<exception_ptr> &errors) {
+    out.clear();
+    errors.clear();
+
+    if (in.empty()) return;
+
+    for (auto &cmd : in) trackSymbols(cmd);
+
+    out.reserve(in.size());
+    errors.reserve(in.size());
+
+    if (worker.joinable()) {
+        vector<future<string>> results;
+
+        TimePoint deadline = deadlineAfter(timeout);
+
+        for (auto &cmd : in) results.push_back(enqueue(cmd,strip,NULL,deadline));
+
+        for (auto &res : results) {
+            try {
+                out.push_back(res.get());
+                errors.push_back(exception_ptr());
+            } catch (const FermatException &) {
+                out.push_back("");
+                errors.push_back(current_exception());
+            }
+        }
+
+        return;
+    }
+
+    TimePoint start = stamp();
+    strm.setDeadline(deadlineAfter(timeout));
+    strm.write(in.data(),in.size());
+
+    if (verbose) {
+        for (auto &cmd : in) cout << "<< " << cmd << endl;
     }
 
-    if (out.find("***") != string::npos) {
-        if (out.find("entry > 30 or < 5 means turn off mono multiply.") != string::npos) {
-            return out;
+    exception_ptr lost;     // set after a timeout, the remaining responses are gone
+
+    // every response has to be read, even after an error, to keep the stream in sync.
+    for (auto &cmd : in) {
+        if (lost) {
+            out.push_back("");
+            errors.push_back(lost);
+            continue;
         }
-        
-        if (out.find("Converting variables...") != string::npos) {
-            return out;
+
+        try {
+            out.push_back(receive(cmd,start,strip));
+            errors.push_back(exception_ptr());
+        } catch (const FermatException &e) {
+            out.push_back("");
+            errors.push_back(current_exception());
+            if (dynamic_cast<const FermatTimeout*>(&e)) lost = errors.back();
+        }
+    }
+}
+
+future<string> Fermat::async(string in) {
+    trackSymbols(in);
+
+    // commands queued by batch() were issued first and go first
+    if (batching) flush();
+
+    return enqueue(move(in),false,NULL,deadlineAfter(timeout));
+}
+
+future<string> Fermat::enqueue(string in, bool strip, FermatResponse::Sink *sink, TimePoint deadline) {
+    AsyncJob job;
+    future<string> res = job.result.get_future();
+    string gc = garbageCommand();
+
+    job.cmd = move(in);
+    job.strip = strip;
+    job.sink = sink;
+    job.deadline = deadline;
+
+    {
+        lock_guard<mutex> lock(mtx);
+
+        if (!gc.empty()) {
+            AsyncJob del;
+            del.cmd = gc;
+            del.strip = false;
+            del.sink = NULL;
+            del.deadline = deadline;
+            jobs.push_back(move(del));
+        }
+
+        jobs.push_back(move(job));
+        if (!worker.joinable()) worker = thread(&Fermat::run,this);
+    }
+    cv.notify_one();
+
+    return res;
+}
+
+void Fermat::run() {
+    unique_lock<mutex> lock(mtx);
+
+    for (;;) {
+        cv.wait(lock,[this] { return stopping || !jobs.empty(); });
+        if (jobs.empty()) return;
+
+        // everything queued so far is written in one go and answered in order.
+        deque<AsyncJob> current;
+        current.swap(jobs);
+        lock.unlock();
+
+        vector<string> in;
+        TimePoint deadline = TimePoint::max();
+
+        in.reserve(current.size());
+        for (auto &job : current) {
+            in.push_back(job.cmd);
+            deadline = min(deadline,job.deadline);
+        }
+
+        TimePoint start = stamp();
+        strm.setDeadline(deadline);
+        strm.write(in.data(),in.size());
+
+        if (verbose) {
+            for (auto &cmd : in) cout << "<< " << cmd << endl;
+        }
+
+        exception_ptr lost;
+
+        for (auto &job : current) {
+            if (lost) {
+                job.result.set_exception(lost);
+                continue;
+            }
+
+            try {
+                strm.setDeadline(job.deadline);
+                job.result.set_value(receive(job.cmd,start,job.strip,job.sink));
+            } catch (const FermatTimeout &) {
+                lost = current_exception();
+                job.result.set_exception(lost);
+            } catch (...) {
+                job.result.set_exception(current_exception());
+            }
+        }
+
+        lock.lock();
+    }
+}
+
+void Fermat::instrument(bool on) {
+    instrumented = on;
+}
+
+FermatStats Fermat::stats() {
+    lock_guard<mutex> lock(statsMtx);
+    return _stats;
+}
+
+void Fermat::resetStats() {
+    lock_guard<mutex> lock(statsMtx);
+    _stats.reset();
+}
+
+void Fermat::trace(const string &file, size_t capacity) {
+    unique_ptr<FermatTrace> t(new FermatTrace(file,capacity));
+    unique_ptr<FermatTrace> old;
+
+    {
+        lock_guard<mutex> lock(statsMtx);
+        old.swap(tracer);
+        tracer.swap(t);
+        traceStart = chrono::steady_clock::now();
+        tracing = true;
+    }
+}
+
+uint64_t Fermat::stopTrace() {
+    unique_ptr<FermatTrace> t;
+
+    {
+        lock_guard<mutex> lock(statsMtx);
+        tracing = false;
+        t.swap(tracer);
+    }
+
+    return t ? t->dropped() : 0;    // t is flushed and closed here
+}
+
+Fermat::TimePoint Fermat::stamp() const {
+    return (instrumented || tracing) ? chrono::steady_clock::now() : TimePoint();
+}
+
+void Fermat::account(const string &in, TimePoint start, size_t read, bool error) {
+    if (start == TimePoint()) return;   // instrumentation was switched on in between
+
+    TimePoint now = chrono::steady_clock::now();
+    double us = chrono::duration<double,micro>(now-start).count();
+    FermatStats::Kind kind = FermatStats::classify(in);
+
+    lock_guard<mutex> lock(statsMtx);
+
+    if (instrumented) _stats.record(kind,us,in.size()+2,read,error);
+
+    if (tracer && start >= traceStart) {
+        uint64_t time = chrono::duration_cast<chrono::nanoseconds>(start-traceStart).count();
+        tracer->record(in,time,(uint32_t)us,(uint32_t)read,kind,error);
+    }
+}
+
+string Fermat::receive(const string &in, TimePoint start, bool strip, FermatResponse::Sink *sink) {
+    FermatResponse resp(strip,sink);
+    string str;
+
+    if (verbose) {
+        resp.onLine = [](const string &line) { cout << ">> " << line << endl; };
+    }
+
+    if (!strm.scan(resp) && strm.timedOut()) {
+        if (instrumented || tracing) account(in,start,resp.consumed(),true);
+        respawn();
+        throw FermatTimeout("Fermat timeout\ninput was: "+in);
+    }
+
+    size_t read = resp.consumed();
+
+    if (resp.error()) {
+        const string &out = resp.head();
+
+        if (out.find("entry > 30 or < 5 means turn off mono multiply.") != string::npos ||
+            out.find("Converting variables...") != string::npos) {
+            if (instrumented || tracing) account(in,start,read,false);
+            return move(resp.output());
         }
 
-        while(getline(strm,str)) {
+        while(strm.getline(str)) {
+            read += str.size()+1;
             if (str == ">") break;
         }
-        
+
+        if (instrumented || tracing) account(in,start,read,true);
+
+        if (strm.timedOut()) {
+            respawn();
+            throw FermatTimeout("Fermat timeout\ninput was: "+in);
+        }
+
         if (out.find("can't divide by 0.") != string::npos) {
             throw FermatDivByZero("Fermat error:\n"+out+"\ninput was: "+in);
         } else {
             throw FermatException("Fermat error:\n"+out+"\ninput was: "+in);
         }
     }
-    return out;
+
+    if (instrumented || tracing) account(in,start,read,false);
+
+    if (resp.sinkError()) rethrow_exception(resp.sinkError());
+
+    return move(resp.output());
 }
 
 bool Fermat::check() {
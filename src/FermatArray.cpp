@@ -21,32 +21,149 @@
 
 #include <FermatArray.h>
 #include <FermatException.h>
+#include <FermatPool.h>
 #include <stdexcept>
+#include <algorithm>
 #include <sstream>
 #include <iostream>
+#include <cstdlib>
 using namespace std;
 
+namespace {
+    // cuts the entries out of the whitespace-free output of [x] or ![x]:
+    //   dense:  [[1,2],[3,4]]`
+    //   sparse: [x]:=[[1,[1,1][2,2]][2,[1,3][2,4]]]`
+    class ElementParser : public FermatResponse::Sink {
+        public:
+            typedef function<void(int,int,const string&)> Callback;
+
+            ElementParser(const Callback &callback, bool sparse) : callback(callback), sparse(sparse) {
+                started = !sparse;
+                last = 0;
+                depth = 0;
+                row = col = 0;
+                index = false;
+            }
+
+            void put(const char *data, size_t len) {
+                for (size_t n=0; n<len; ++n) {
+                    char ch = data[n];
+
+                    if (!started) {
+                        started = (last == ':' && ch == '=');
+                        last = ch;
+                        continue;
+                    }
+
+                    if (sparse) {
+                        parseSparse(ch);
+                    } else {
+                        parseDense(ch);
+                    }
+                }
+            }
+        private:
+            void parseDense(char ch) {
+                switch (ch) {
+                    case '[':
+                        if (++depth == 2) {
+                            row++;
+                            col = 0;
+                            entry.clear();
+                        }
+                        break;
+                    case ',':
+                    case ']':
+                        if (depth == 2) {
+                            callback(row,++col,entry);
+                            entry.clear();
+                        }
+                        if (ch == ']') depth--;
+                        break;
+                    default:
+                        if (depth == 2) entry += ch;
+                }
+            }
+
+            void parseSparse(char ch) {
+                switch (ch) {
+                    case '[':
+                        if (++depth >= 2) {
+                            index = true;
+                            entry.clear();
+                        }
+                        break;
+                    case ',':
+                        if (index) {
+                            if (depth == 2) {
+                                row = atoi(entry.c_str());
+                            } else {
+                                col = atoi(entry.c_str());
+                            }
+                            index = false;
+                            entry.clear();
+                        } else if (depth >= 2) {
+                            entry += ch;
+                        }
+                        break;
+                    case ']':
+                        if (depth == 3) callback(row,col,entry);
+                        entry.clear();
+                        depth--;
+                        break;
+                    default:
+                        if (depth >= 2) entry += ch;
+                }
+            }
+
+            const Callback &callback;
+            bool sparse;
+            bool started;       // ":=" seen
+            char last;
+            int depth;
+            int row;
+            int col;
+            bool index;         // reading a row or column index
+            string entry;
+    };
+}
+
 FermatArray::FermatArray() {
     fermat = NULL;
     r=c=0;
+    _version = 0;
 }
 
 FermatArray::FermatArray(const FermatArray &array) {
     fermat = NULL;
+    _version = 0;
     *this = array;
 }
 
+// takes over the array, nothing is sent to Fermat
+FermatArray::FermatArray(FermatArray &&array) noexcept : _name(move(array._name)) {
+    fermat = array.fermat;
+    r = array.r;
+    c = array.c;
+    _version = array._version;
+
+    array.fermat = NULL;
+    array.r = array.c = 0;
+    array._version = 0;
+}
+
 FermatArray::FermatArray(Fermat *fermat) {
     this->fermat = fermat;
-    _name = fermat->getUnique();
+    _name = fermat->getUnique(true);
     r=c=0;
+    modified();
 }
 
 FermatArray::FermatArray(Fermat *fermat, int n) {
 	stringstream strm;
 
 	this->fermat = fermat;
-	_name = fermat->getUnique();
+	_name = fermat->getUnique(true);
 
 	r = n;
 	c = -1;
@@ -65,19 +182,22 @@ FermatArray::FermatArray(Fermat *fermat, int n) {
     (*fermat)("&(U=1)");
 
 	(*fermat)(string("[")+_name+"]");
+    fermat->markVector(_name);
+    modified();
 }
 
 FermatArray::FermatArray(Fermat *fermat, int r, int c, bool sparse) {
     if (r<=0 || c<=0) {
         this->fermat = NULL;
         this->r = this->c = 0;
+        _version = 0;
         return;
     }
 
 	stringstream strm;
 
 	this->fermat = fermat;
-	_name = fermat->getUnique();
+	_name = fermat->getUnique(true);
 
 	this->r = r;
 	this->c = c;
@@ -101,6 +221,8 @@ FermatArray::FermatArray(Fermat *fermat, int r, int c, bool sparse) {
 	if (!sparse) {
         (*fermat)(string("[")+_name+"]");
     }
+
+    modified();
 }
 
 FermatArray::FermatArray(Fermat *fermat, std::string str) {
@@ -108,7 +230,7 @@ FermatArray::FermatArray(Fermat *fermat, std::string str) {
     string tmp;
 
 	this->fermat = fermat;
-	_name = fermat->getUnique();
+	_name = fermat->getUnique(true);
 
     r = count(str.begin(),str.end(),'{')-1;
     c = (count(str.begin(),str.end(),',')+1)/r;
@@ -118,7 +240,7 @@ FermatArray::FermatArray(Fermat *fermat, std::string str) {
             return c=='{' || c=='}' || c==' ' || c=='\t';
         }),str.end());
 
-    tmp = fermat->getUnique();
+    tmp = fermat->getUnique(true);
     
     strm << "Array " << tmp << "[" << c << "," << r << "]";
 
@@ -135,18 +257,20 @@ FermatArray::FermatArray(Fermat *fermat, std::string str) {
 
     (*fermat)(string("[")+tmp+"] := [["+str+"]]");
     (*fermat)(string("[")+_name+"] := Trans["+tmp+"]");
-    (*fermat)(string("@[")+tmp+"]");
+    fermat->release(tmp,true);
+    modified();
 }
 
 FermatArray::FermatArray(const FermatArray &array, int rfrom, int rto, int cfrom, int cto) {
     if (rto < rfrom || cto < cfrom) {
         fermat = NULL;
         r=c=0;
+        _version = 0;
         return;
     }
 
     fermat = array.fermat;
-    _name = fermat->getUnique();
+    _name = fermat->getUnique(true);
 
     stringstream strm;
 
@@ -156,32 +280,35 @@ FermatArray::FermatArray(const FermatArray &array, int rfrom, int rto, int cfrom
     strm << "[" << _name << "] := [" << array._name << "[" << rfrom << "~" << rto << "," << cfrom << "~" << cto << "]]";
 
     (*fermat)(strm.str());
+    modified();
 }
 
 FermatArray::FermatArray(const FermatArray &mat1, const FermatArray &mat2) {
     fermat = mat1.fermat;
-    _name = fermat->getUnique();
+    _name = fermat->getUnique(true);
     
     r = mat1.r;
     c = mat2.c;
 
     (*fermat)(string("[")+_name+"] := ["+mat1._name+"]*["+mat2._name+"]");
+    modified();
 }
 
 FermatArray::FermatArray(const FermatArray &mat1, const FermatArray &mat2, const FermatArray &mat3) {
     fermat = mat1.fermat;
-    _name = fermat->getUnique();
+    _name = fermat->getUnique(true);
     
     r = mat1.r;
     c = mat3.c;
 
     (*fermat)(string("[")+_name+"] := ["+mat1._name+"]*["+mat2._name+"]*["+mat3._name+"]");
+    modified();
 }
 
 FermatArray::~FermatArray() {
     if (!fermat) return;
 
-	(*fermat)(string("@[")+_name+"]");
+	fermat->release(_name,true);
 }
 
 string FermatArray::name() const {
@@ -192,6 +319,14 @@ Fermat *FermatArray::fer() const {
     return fermat;
 }
 
+uint64_t FermatArray::version() const {
+    return _version;
+}
+
+void FermatArray::modified() {
+    _version = fermat ? fermat->newVersion() : 0;
+}
+
 void FermatArray::assign(string str) {
     if (!fermat) throw invalid_argument("not initialized");
 
@@ -199,20 +334,48 @@ void FermatArray::assign(string str) {
 
     (*fermat)("["+_name+"]:="+str);
 
-    strm.str((*fermat)("Cols["+_name+"]"));
+    // both queries in one round trip, after the assignment if it is queued
+    vector<string> dims = fermat->stripped(vector<string>{"Cols["+_name+"]","Deg["+_name+"]"});
+
+    strm.str(dims[0]);
     strm >> c;
 
     strm.clear();
-    strm.str((*fermat)("Deg["+_name+"]"));
+    strm.str(dims[1]);
     strm >> r;
     
     r /= c;
+    modified();
 }
     
 void FermatArray::drop() {
     if (!fermat) throw invalid_argument("not initialized");
    if (r) (*fermat)("@["+_name+"]");
    r = c = 0;
+   modified();
+}
+
+FermatArray FermatArray::adopt(Fermat *fermat, const string &name) {
+    FermatArray array;
+    stringstream strm;
+
+    array.fermat = fermat;
+    array._name = name;
+
+    vector<string> dims = fermat->stripped(vector<string>{"Cols["+name+"]","Deg["+name+"]"});
+
+    strm.str(dims[0]);
+    strm >> array.c;
+
+    strm.clear();
+    strm.str(dims[1]);
+    strm >> array.r;
+
+    array.r /= array.c;
+    if (fermat->isVector(name)) array.c = -1;
+    array.modified();
+
+    return array;
 }
 
 void FermatArray::set(int r, int c, const FermatExpression &expr) {
@@ -220,9 +383,10 @@ void FermatArray::set(int r, int c, const FermatExpression &expr) {
 
     stringstream strm;
 
-    strm << _name << "[" << r << "," << c << "]:=" << expr.name();
+    strm << _name << "[" << r << "," << c << "]:=" << expr.term();
 
     (*fermat)(strm.str());
+    modified();
 }
 
 void FermatArray::set(int r, int c, int i) {
@@ -233,6 +397,7 @@ void FermatArray::set(int r, int c, int i) {
     strm << _name << "[" << r << "," << c << "]:=" << i;
 
     (*fermat)(strm.str());
+    modified();
 }
 
 void FermatArray::set(int n, const FermatExpression &expr) {
@@ -240,9 +405,10 @@ void FermatArray::set(int n, const FermatExpression &expr) {
 
     stringstream strm;
 
-    strm << _name << "[" << n << "]:=" << expr.name();
+    strm << _name << "[" << n << "]:=" << expr.term();
 
     (*fermat)(strm.str());
+    modified();
 }
 
 void FermatArray::set(int r, int c, string expr) {
@@ -253,6 +419,7 @@ void FermatArray::set(int r, int c, string expr) {
     strm << _name << "[" << r << "," << c << "]:=" << expr;
 
     (*fermat)(strm.str());
+    modified();
 }
 
 void FermatArray::set(int n, string expr) {
@@ -263,6 +430,7 @@ void FermatArray::set(int n, string expr) {
     strm << _name << "[" << n << "]:=" << expr;
 
     (*fermat)(strm.str());
+    modified();
 }
         
 void FermatArray::setColumn(int c, const FermatArray &v) {
@@ -273,6 +441,7 @@ void FermatArray::setColumn(int c, const FermatArray &v) {
     strm << "[" << _name << "[1~" << r << "," << c << "]] := [" << v._name << "]";
 
     (*fermat)(strm.str());
+    modified();
 }
 
 void FermatArray::setRow(int r, const FermatArray &v) {
@@ -288,6 +457,7 @@ void FermatArray::setRow(int r, const FermatArray &v) {
     } 
 
     (*fermat)(strm.str());
+    modified();
 }
 
 FermatArray FermatArray::concatenate(const FermatArray &array) const {
@@ -312,7 +482,7 @@ FermatArray FermatArray::transpose() const {
 
     FermatArray n(fermat);
 
-    n.assign("Trans["+_name+"]");
+    n.evaluate("Trans["+_name+"]",fermat->memoizing() ? "Trans[@"+to_string(_version)+"]" : "");
     return n;
 }
 
@@ -321,19 +491,19 @@ FermatArray FermatArray::inverse() const {
 
     FermatArray n(fermat);
 
-    n.assign("1/["+_name+"]");
+    n.evaluate("1/["+_name+"]",fermat->memoizing() ? "1/[@"+to_string(_version)+"]" : "");
     return n;
 }
 
 int FermatArray::rank() {
     int rk;
     stringstream strm;
-    string tmp = fermat->getUnique();
+    string tmp = fermat->getUnique(true);
 
     (*fermat)("["+tmp+"] := ["+_name+"]");
-    strm.str((*fermat)("Colreduce(["+tmp+"])"));
+    strm.str(fermat->stripped("Colreduce(["+tmp+"])"));
     strm >> rk;
-    (*fermat)("@["+tmp+"]");
+    fermat->release(tmp,true);
 
     return rk;
 }
@@ -342,8 +512,9 @@ int FermatArray::rowEchelon() {
     int rk;
     stringstream strm;
 
-    strm.str((*fermat)("Redrowech(["+_name+"])"));
+    strm.str(fermat->stripped("Redrowech(["+_name+"])"));
     strm >> rk;
+    modified();
 
     return rk;
 }
@@ -355,8 +526,11 @@ int FermatArray::colReduce(FermatArray &A, FermatArray &B) {
     A = FermatArray(fermat,r,r);
     B = FermatArray(fermat,c,c);
 
-    strm.str((*fermat)("Colreduce(["+_name+"],["+A._name+"],["+B._name+"])"));
+    strm.str(fermat->stripped("Colreduce(["+_name+"],["+A._name+"],["+B._name+"])"));
     strm >> rk;
+    modified();
+    A.modified();
+    B.modified();
 
     return rk;
 }
@@ -376,9 +550,9 @@ FermatExpression FermatArray::operator()(int r, int c) const {
     FermatExpression nn(fermat);
     stringstream strm;
 
-    strm << nn.name() << ":=" << _name << "[" << r << "," << c << "]";
+    strm << _name << "[" << r << "," << c << "]";
 
-    (*fermat)(strm.str());
+    nn.evaluate(strm.str(),"");
 
     return nn;
 }
@@ -389,9 +563,9 @@ FermatExpression FermatArray::operator()(int n) const {
     FermatExpression nn(fermat);
     stringstream strm;
 
-    strm << nn.name() << ":=" << _name << "[" << n << "]";
+    strm << _name << "[" << n << "]";
 
-    (*fermat)(strm.str());
+    nn.evaluate(strm.str(),"");
 
     return nn;
 }
@@ -432,7 +606,7 @@ FermatArray FermatArray::operator*(const FermatExpression &expr) const {
 
     FermatArray n(fermat);
 
-    n.assign(string("[")+_name+"]*"+expr.name());
+    n.assign(string("[")+_name+"]*"+expr.term());
 
     return n;
 }
@@ -442,7 +616,7 @@ FermatArray FermatArray::operator/(const FermatExpression &expr) const {
 
     FermatArray n(fermat);
 
-    n.assign(string("[")+_name+"]/"+expr.name());
+    n.assign(string("[")+_name+"]/"+expr.term());
 
     return n;
 }
@@ -472,17 +646,20 @@ FermatArray FermatArray::operator-() const {
 }
 
 FermatArray &FermatArray::operator=(const FermatArray &array) {
+    if (this == &array) return *this;
+
     if (!array.fermat) {
-        if (fermat) (*fermat)(string("@[")+_name+"]");
+        if (fermat) fermat->release(_name,true);
         fermat = NULL;
         r = c = 0;
+        _version = 0;
         return *this;
     }
     if (!fermat) {
         stringstream strm;
 
         fermat = array.fermat;
-        _name = fermat->getUnique();
+        _name = fermat->getUnique(true);
     } else if (r && c && (r != array.r || c != array.c)) {
         (*fermat)(string("@[")+_name+"]");
     }
@@ -491,6 +668,27 @@ FermatArray &FermatArray::operator=(const FermatArray &array) {
     c = array.c;
 
     (*fermat)(string("[")+_name+"]:=["+array._name+"]");
+    if (c == -1) fermat->markVector(_name);
+    _version = array._version;      // the same value
+
+    return *this;
+}
+
+FermatArray &FermatArray::operator=(FermatArray &&array) {
+    if (this == &array) return *this;
+
+    if (fermat) fermat->release(_name,true);
+
+    fermat = array.fermat;
+    _name = move(array._name);
+    r = array.r;
+    c = array.c;
+    _version = array._version;
+
+    array.fermat = NULL;
+    array.r = array.c = 0;
+    array._version = 0;
+
     return *this;
 }
 
@@ -502,6 +700,7 @@ FermatArray &FermatArray::operator*=(int i) {
     strm << "[" << _name << "] := [" << _name << "]*(" << i << ")";
 
     (*fermat)(strm.str());
+    modified();
 
     return *this;
 }
@@ -516,6 +715,7 @@ FermatArray &FermatArray::operator+=(const FermatArray &array) {
     if (r != array.r || c != array.c) throw invalid_argument("matrices not compatible.");
 
     (*fermat)(string("[")+_name+"]:=["+_name+"]+["+array._name+"]");
+    modified();
 
     return *this;
 }
@@ -530,6 +730,7 @@ FermatArray &FermatArray::operator-=(const FermatArray &array) {
     if (r != array.r || c != array.c) throw invalid_argument("matrices not compatible.");
 
     (*fermat)(string("[")+_name+"]:=["+_name+"]-["+array._name+"]");
+    modified();
 
     return *this;
 }
@@ -539,7 +740,7 @@ FermatExpression FermatArray::det() const {
 
     FermatExpression expr(fermat);
 
-    (*fermat)(expr.name()+":=Det["+_name+"]");
+    expr.evaluate("Det["+_name+"]",fermat->memoizing() ? "Det[@"+to_string(_version)+"]" : "");
 
     return expr;
 }
@@ -549,19 +750,43 @@ FermatExpression FermatArray::chPoly() const {
 
     FermatExpression expr(fermat);
 
-    (*fermat)(expr.name()+":=Chpoly(["+_name+"])");
+    expr.evaluate("Chpoly(["+_name+"])","");
 
     return expr;
 }
 
+void FermatArray::evaluate(const string &cmd, const string &key) {
+    string kept;
+    int rows, cols;
+
+    if (key.empty()) {
+        assign(cmd);
+    } else if (fermat->memoFind(key,kept,rows,cols)) {
+        (*fermat)("["+_name+"]:=["+kept+"]");
+        r = rows;
+        c = cols;
+        modified();
+    } else {
+        // computed and kept in one go
+        kept = fermat->getUnique(true);
+
+        try {
+            assign(cmd+"; ["+kept+"]:=["+_name+"]");
+        } catch (...) {
+            fermat->release(kept,true);
+            throw;
+        }
+
+        fermat->memoAdd(key,kept,true,r,c);
+    }
+}
+
 bool FermatArray::isZero() const {
     if (!fermat) return true;
 
     string res;
 
-    res = (*fermat)(string("Iszero[")+_name+"]");
-
-    res.erase(remove_if(res.begin(),res.end(), ::isspace), res.end());
+    res = fermat->stripped(string("Iszero[")+_name+"]");
    
     return res == "1";
 }
@@ -590,7 +815,23 @@ FermatArray FermatArray::subst(string symbol, const FermatExpression &ex) const
     FermatArray n(fermat);
 
     try {
-        n.assign("["+_name+"]#("+symbol+"="+ex.name()+")");
+        n.assign("["+_name+"]#("+symbol+"="+ex.term()+")");
+    } catch(const FermatException &e) {
+        n.fermat = NULL;
+        throw;
+    }
+
+    return n;
+}
+
+FermatArray FermatArray::subst(const map<string,FermatExpression> &repl) const {
+    if (!fermat) throw invalid_argument("not initialized");
+    if (repl.empty()) return *this;
+    
+    FermatArray n(fermat);
+
+    try {
+        n.assign("["+_name+"]#("+FermatExpression::substList(repl)+")");
     } catch(const FermatException &e) {
         n.fermat = NULL;
         throw;
@@ -599,12 +840,116 @@ FermatArray FermatArray::subst(string symbol, const FermatExpression &ex) const
     return n;
 }
 
+FermatArray FermatArray::subst(const map<string,int> &repl) const {
+    if (!fermat) throw invalid_argument("not initialized");
+    if (repl.empty()) return *this;
+    
+    FermatArray n(fermat);
+
+    try {
+        n.assign("["+_name+"]#("+FermatExpression::substList(repl)+")");
+    } catch(const FermatException &e) {
+        n.fermat = NULL;
+        throw;
+    }
+
+    return n;
+}
+
+FermatArray FermatArray::jacobian(const vector<string> &symbols) const {
+    if (!fermat) throw invalid_argument("not initialized");
+    if (symbols.empty()) throw invalid_argument("no symbols");
+
+    int n = c == -1 || c == 1 ? r : r == 1 ? c : 0;
+
+    if (!n) throw invalid_argument("jacobian of a matrix");
+
+    FermatArray J(fermat,n,(int)symbols.size());
+    vector<string> cmds;
+
+    cmds.reserve(n);
+
+    for (int i=1; i<=n; ++i) {
+        string entry = _name+(c == -1 ? "["+to_string(i)+"]" : r == 1 ? "[1,"+to_string(i)+"]" : "["+to_string(i)+",1]");
+        string cmd;
+
+        for (size_t j=0; j<symbols.size(); ++j) {
+            if (j) cmd += "; ";
+            cmd += J._name+"["+to_string(i)+","+to_string(j+1)+"]:=Deriv("+entry+","+symbols[j]+",1)";
+        }
+
+        cmds.push_back(move(cmd));
+    }
+
+    fermat->submit(cmds);
+    J.modified();
+
+    return J;
+}
+
+FermatArray FermatArray::jacobian(const vector<string> &symbols, FermatPool &pool) const {
+    if (!fermat) throw invalid_argument("not initialized");
+    if (symbols.empty()) throw invalid_argument("no symbols");
+
+    int n = c == -1 || c == 1 ? r : r == 1 ? c : 0;
+
+    if (!n) throw invalid_argument("jacobian of a matrix");
+
+    vector<future<vector<string>>> rows;
+
+    rows.reserve(n);
+
+    // the entries arrive in order, as the vector has one row or column
+    elements([&](int, int, const string &entry) {
+        rows.push_back(pool.submit([entry,symbols](Fermat &f) {
+            FermatExpression ex(&f,entry);
+            vector<string> cmds;
+
+            for (auto &s : symbols) cmds.push_back("Deriv("+ex.name()+","+s+",1)");
+
+            vector<string> res = f.stripped(cmds);
+
+            for (auto &d : res) {
+                size_t pos = d.find(";or");
+                if (pos != string::npos) d.erase(pos);
+            }
+
+            return res;
+        }));
+    });
+
+    if (rows.size() != (size_t)n) {
+        throw runtime_error("jacobian: "+to_string(rows.size())+" entries read, "+to_string(n)+" expected");
+    }
+
+    FermatArray J(fermat,n,(int)symbols.size());
+    vector<string> cmds;
+
+    cmds.reserve(n);
+
+    for (int i=1; i<=n; ++i) {
+        vector<string> derivs = rows[i-1].get();
+        string cmd;
+
+        for (size_t j=0; j<derivs.size(); ++j) {
+            if (j) cmd += "; ";
+            cmd += J._name+"["+to_string(i)+","+to_string(j+1)+"]:="+derivs[j];
+        }
+
+        cmds.push_back(move(cmd));
+    }
+
+    fermat->submit(cmds);
+    J.modified();
+
+    return J;
+}
+
 string FermatArray::str() const {
     if (!fermat) return "<uninitialized>";
 
-    string str = (*fermat)(string("[")+_name+"]");
+    string str = fermat->stripped(string("[")+_name+"]");
 
-    str.erase(remove_if(str.begin(), str.end(), ::isspace), str.end());
     str.pop_back();
 
     for (char &c : str) {
@@ -621,9 +966,8 @@ string FermatArray::str() const {
 string FermatArray::sstr() const {
     if (!fermat) return "<uninitialized>";
 
-    string str = (*fermat)(string("![")+_name+"]");
-    
-    str.erase(remove_if(str.begin(), str.end(), ::isspace), str.end());
+    string str = fermat->stripped(string("![")+_name+"]");
+
     str.pop_back();
 
     str.erase(0,str.find(":=")+2);
@@ -641,5 +985,11 @@ string FermatArray::sstr() const {
     
     return str1;
 }
-   
-    
+
+void FermatArray::elements(const function<void(int,int,const string&)> &callback, bool sparse) const {
+    if (!fermat) throw invalid_argument("not initialized");
+
+    ElementParser parser(callback,sparse);
+
+    fermat->stream(string(sparse ? "![" : "[")+_name+"]",parser);
+}
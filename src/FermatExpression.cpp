@@ -20,77 +20,195 @@
  */
 
 #include <FermatExpression.h>
+#include <FermatArray.h>
 #include <stdexcept>
+#include <algorithm>
 #include <sstream>
 using namespace std;
 
+namespace {
+    // a rational as an operand in a Fermat command
+    string literal(const FermatRational &num) {
+        if (num.isInteger() && num.sign() >= 0) return num.str();
+
+        return "("+num.str()+")";
+    }
+}
+
 FermatExpression::FermatExpression() {
     fermat = NULL;
+    _version = cached = 0;
+    _local = false;
 }
 
 FermatExpression::FermatExpression(const FermatExpression &expr) {
     fermat = expr.fermat;
-    _name = fermat->getUnique();
+    _version = cached = 0;
+    _local = false;
+    if (!fermat) return;
 
     *this = expr;
 }
 
+// takes over the variable, nothing is sent to Fermat
+FermatExpression::FermatExpression(FermatExpression &&expr) noexcept : _name(move(expr._name)), _value(move(expr._value)), cache(move(expr.cache)) {
+    fermat = expr.fermat;
+    _version = expr._version;
+    _local = expr._local;
+    cached = expr.cached;
+
+    expr.fermat = NULL;
+    expr._name.clear();
+    expr._version = expr.cached = 0;
+    expr._local = false;
+}
+
 FermatExpression::FermatExpression(Fermat *fermat) {
 	this->fermat = fermat;
-	_name = fermat->getUnique();
+    _version = cached = 0;
+    _local = false;
 
     *this = 0;
 }
 
 FermatExpression::FermatExpression(Fermat *fermat, string expr) {
 	this->fermat = fermat;
-	_name = fermat->getUnique();
+    _version = cached = 0;
+    _local = false;
 
 	*this = expr;
 }
 
 FermatExpression::FermatExpression(Fermat *fermat, int num) {
 	this->fermat = fermat;
-	_name = fermat->getUnique();
+    _version = cached = 0;
+    _local = false;
+
+	*this = num;
+}
+
+FermatExpression::FermatExpression(Fermat *fermat, const FermatRational &num) {
+	this->fermat = fermat;
+    _version = cached = 0;
+    _local = false;
 
 	*this = num;
 }
 
 FermatExpression::~FermatExpression() {
-    if (!fermat) return;
+    if (!fermat || _name.empty()) return;
+
+	fermat->release(_name);
+}
 
-	(*fermat)(string("@") + _name);
+FermatExpression FermatExpression::adopt(Fermat *fermat, const string &name) {
+    FermatExpression expr;
+
+    expr.fermat = fermat;
+    expr._name = name;
+    expr.modified();
+
+    return expr;
 }
 
 string FermatExpression::str() const {
     if (!fermat) return "<uninitialized>";
 
-	string res = (*fermat)(_name);
-    res.erase(remove_if(res.begin(), res.end(), ::isspace), res.end());
+    if (_local) return _value.str();
+    if (hasCache()) return cache;
+
+	string res = fermat->stripped(_name);
 
     size_t pos = res.find(";or");
     if (pos != string::npos) {
         res.erase(pos);
     }
 
+    // Fermat never prints an empty value: an empty response was not read
+    if (!res.empty()) {
+        cache = res;
+        cached = _version;
+    }
+
     return res;
 }
 
+// a constant is put into a variable the first time it is needed. The
+// caller may assign to the variable, so the local value, the cached str()
+// and memo entries keyed by the old version are given up.
 string FermatExpression::name() const {
+    if (!fermat) return _name;
+
+    if (_local && _name.empty()) {
+        _name = fermat->getUnique();
+
+        try {
+            (*fermat)(_name+":="+_value.str());
+        } catch (...) {
+            fermat->release(_name);
+            _name.clear();
+            throw;
+        }
+    }
+
+    _local = false;
+    _version = fermat->newVersion();
+    cache.clear();
+    cached = 0;
+
     return _name;
 }
 
+string FermatExpression::term() const {
+    return _local ? literal(_value) : _name;
+}
+
+bool FermatExpression::isLocal() const {
+    return _local;
+}
+
+void FermatExpression::setLocal(const FermatRational &num) {
+    if (!_name.empty()) {
+        fermat->release(_name);
+        _name.clear();
+    }
+
+    _local = true;
+    _value = num;
+    _version = fermat->newVersion();
+}
+
 Fermat *FermatExpression::fer() const {
     return fermat;
 }
 
+bool FermatExpression::hasCache() const {
+    return cached && cached == _version && fermat->isCurrent(_version);
+}
+
+uint64_t FermatExpression::version() const {
+    return _version;
+}
+
+void FermatExpression::modified() {
+    if (!_name.empty()) _local = false;
+    _version = fermat ? fermat->newVersion() : 0;
+}
+
 FermatExpression &FermatExpression::operator=(const string &expr) {
     if (!fermat) throw invalid_argument("not initialized");
 
+    FermatRational num;
+
+    if (FermatRational::parse(expr,num)) {
+        setLocal(num);
+        return *this;
+    }
+
     (*fermat)("&(U=0)");
 
     try {
-	    (*fermat)(_name+":="+expr);
+	    evaluate(expr,"");
     } catch(...) {
         (*fermat)("&(U=1)");
         throw;
@@ -104,149 +222,203 @@ FermatExpression &FermatExpression::operator=(const string &expr) {
 FermatExpression &FermatExpression::operator=(int num) {
     if (!fermat) throw invalid_argument("not initialized");
 
-    stringstream strm;
+    setLocal(FermatRational(num));
 
-    strm.str("");
-    strm << _name << ":=" << num;
-    (*fermat)(strm.str());
+    return *this;
+}
+
+FermatExpression &FermatExpression::operator=(const FermatRational &num) {
+    if (!fermat) throw invalid_argument("not initialized");
+
+    setLocal(num);
 
     return *this;
 }
 
 FermatExpression &FermatExpression::operator=(const FermatExpression &expr) {
+    if (this == &expr) return *this;
+
     if (!fermat) {
         if (!expr.fermat) return *this;
         fermat = expr.fermat;
-        _name = fermat->getUnique();
     }
 
     if (!expr.fermat) {
-	    (*fermat)(string("@") + _name);
+	    if (!_name.empty()) fermat->release(_name);
         fermat = NULL;
+        _name.clear();
+        _version = 0;
+        _local = false;
         return *this;
     }
 
-    (*fermat)(_name+":="+expr._name);
-    return *this;
-}
-
-FermatExpression FermatExpression::operator+(const FermatExpression &other) const {
-    if (!fermat) throw invalid_argument("not initialized");
-	
-    FermatExpression n(fermat);
+    if (expr._local) {
+        setLocal(expr._value);
+    } else {
+        evaluate(expr._name,"");
+    }
 
-	(*fermat)(n._name+":="+_name+"+"+other._name);
+    // a copy is the same value: it keeps the version, which lets it hit
+    // the memo, and shares the cached text
+    _version = expr._version;
+    cache = expr.cache;
+    cached = expr.cached;
 
-	return n;
+    return *this;
 }
 
-FermatExpression FermatExpression::operator-(const FermatExpression &other) const {
-    if (!fermat) throw invalid_argument("not initialized");
+FermatExpression &FermatExpression::operator=(FermatExpression &&expr) {
+    if (this == &expr) return *this;
 
-	FermatExpression n(fermat);
+    if (fermat && !_name.empty()) fermat->release(_name);
 
-	(*fermat)(n._name+":="+_name+"-"+other._name);
+    fermat = expr.fermat;
+    _name = move(expr._name);
+    _version = expr._version;
+    _local = expr._local;
+    _value = move(expr._value);
+    cache = move(expr.cache);
+    cached = expr.cached;
+
+    expr.fermat = NULL;
+    expr._name.clear();
+    expr._version = expr.cached = 0;
+    expr._local = false;
 
-	return n;
+    return *this;
 }
 
-FermatExpression FermatExpression::operator*(const FermatExpression &other) const {
-    if (!fermat) throw invalid_argument("not initialized");
-
-	FermatExpression n(fermat);
-
-	(*fermat)(n._name+":="+_name+"*"+other._name);
+bool FermatExpression::operator==(const FermatExpression &other) const {
+    return equals(other);
+}
 
-	return n;
+bool FermatExpression::operator<(const FermatExpression &other) const {
+    return str() < other.str();
 }
 
-FermatExpression FermatExpression::operator*(int i) const {
+bool FermatExpression::isZero() const {
     if (!fermat) throw invalid_argument("not initialized");
 
-	FermatExpression n(fermat);
-    stringstream strm;
-
-    strm << n._name << ":=" << _name << "*(" << i << ")";
-
-	(*fermat)(strm.str());
+    if (_local) return _value.isZero();
+    if (hasCache()) return cache == "0";
 
-	return n;
+    return fermat->isZero(_name);
 }
 
-FermatExpression FermatExpression::operator/(const FermatExpression &other) const {
-    if (!fermat) throw invalid_argument("not initialized");
+bool FermatExpression::equals(const FermatExpression &other) const {
+    if (!fermat || !other.fermat) throw invalid_argument("not initialized");
 
-	FermatExpression n(fermat);
+    // versions are counted per session
+    if (fermat == other.fermat && _version == other._version) return true;
+    if (_local && other._local) return _value == other._value;
 
-	(*fermat)(n._name+":="+_name+"/"+other._name);
+    // the printed form is canonical; it is all two sessions can compare
+    if (fermat != other.fermat) return str() == other.str();
+    if ((_local || hasCache()) && (other._local || other.hasCache())) return str() == other.str();
 
-	return n;
+    return fermat->isZero(term()+"-"+other.term());
 }
 
-FermatExpression FermatExpression::operator/(int i) const {
+// degrees in all symbols add up to zero; Deg(0,x) may be negative
+bool FermatExpression::isConstant() const {
     if (!fermat) throw invalid_argument("not initialized");
+    if (_local) return true;
 
-	FermatExpression n(fermat);
+    vector<string> symbols = fermat->symbolNames();
+    string cmd;
+    int n;
     stringstream strm;
 
-    strm << n._name << ":=" << _name << "/(" << i << ")";
+    if (symbols.empty()) return true;
+
+    for (auto &sym : symbols) {
+        if (!cmd.empty()) cmd += "+";
+        cmd += "Deg(Numer("+_name+"),"+sym+")+Deg(Denom("+_name+"),"+sym+")";
+    }
 
-	(*fermat)(strm.str());
+    strm.str(fermat->stripped(cmd));
+    strm >> n;
 
-	return n;
+    return n <= 0;
 }
 
-FermatExpression FermatExpression::operator%(uint64_t i) const {
+bool FermatExpression::isPolynomial() const {
     if (!fermat) throw invalid_argument("not initialized");
+    if (_local) return true;
 
-	FermatExpression n(fermat);
+    vector<string> symbols = fermat->symbolNames();
+    string cmd;
+    int n;
     stringstream strm;
 
-    strm << n._name << ":=" << _name << "|(" << i << ")";
+    if (symbols.empty()) return true;
 
-	(*fermat)(strm.str());
+    for (auto &sym : symbols) {
+        if (!cmd.empty()) cmd += "+";
+        cmd += "Deg(Denom("+_name+"),"+sym+")";
+    }
+
+    strm.str(fermat->stripped(cmd));
+    strm >> n;
 
-	return n;
+    return n == 0;
 }
 
-FermatExpression FermatExpression::operator-() const {
+FermatExpression FermatExpression::numer() const {
     if (!fermat) throw invalid_argument("not initialized");
 
     FermatExpression n(fermat);
 
-    (*fermat)(n._name+":= -"+_name);
+    if (_local) {
+        n.setLocal(FermatRational(_value.numer()));
+    } else {
+        n.evaluate("Numer("+_name+")","");
+    }
 
     return n;
 }
 
-bool FermatExpression::operator==(const FermatExpression &other) const {
+FermatExpression FermatExpression::denom() const {
     if (!fermat) throw invalid_argument("not initialized");
 
-    return (*this - other).str() == "0";
-}
+    FermatExpression n(fermat);
 
-bool FermatExpression::operator<(const FermatExpression &other) const {
-    return str() < other.str();
+    if (_local) {
+        n.setLocal(FermatRational(_value.denom()));
+    } else {
+        n.evaluate("Denom("+_name+")","");
+    }
+
+    return n;
 }
 
-FermatExpression FermatExpression::numer() const {
+FermatTerms FermatExpression::terms() const {
     if (!fermat) throw invalid_argument("not initialized");
 
-    FermatExpression n(fermat);
+    FermatTerms res;
+    vector<string> symbols = fermat->symbolNames();
 
-    (*fermat)(n._name+":= Numer("+_name+")");
+    res.numer = FermatPolynomial(symbols);
+    res.denom = FermatPolynomial(symbols);
 
-    return n;
-}
+    if (_local) {
+        vector<int> exps(symbols.size(),0);
 
-FermatExpression FermatExpression::denom() const {
-    if (!fermat) throw invalid_argument("not initialized");
+        if (!_value.isZero()) res.numer.addTerm(FermatRational(_value.numer()),exps.data());
+        res.denom.addTerm(FermatRational(_value.denom()),exps.data());
 
-    FermatExpression n(fermat);
+        return res;
+    }
 
-    (*fermat)(n._name+":= Denom("+_name+")");
+    FermatPolynomial::Parser numer(res.numer), denom(res.denom);
 
-    return n;
+    fermat->stream("Numer("+_name+")",numer);
+    numer.finish();
+
+    fermat->stream("Denom("+_name+")",denom);
+    denom.finish();
+
+    return res;
 }
 
 int FermatExpression::deg(string symbol) const {
@@ -255,7 +427,10 @@ int FermatExpression::deg(string symbol) const {
     int n;
     stringstream strm;
 
-    strm.str((*fermat)("Deg("+_name+","+symbol+")"));
+    // Fermat has its own idea of the degree of 0
+    if (_local && !_value.isZero()) return 0;
+
+    strm.str(fermat->stripped("Deg("+term()+","+symbol+")"));
     strm >> n;
 
     return n;
@@ -267,7 +442,10 @@ int FermatExpression::codeg(string symbol) const {
     int n;
     stringstream strm;
 
-    strm.str((*fermat)("Codeg("+_name+","+symbol+")"));
+    // Fermat has its own idea of the degree of 0
+    if (_local && !_value.isZero()) return 0;
+
+    strm.str(fermat->stripped("Codeg("+term()+","+symbol+")"));
     strm >> n;
 
     return n;
@@ -275,25 +453,229 @@ int FermatExpression::codeg(string symbol) const {
 
 FermatExpression FermatExpression::subst(string symbol, const FermatExpression &repl) const {
     if (!fermat) throw invalid_argument("not initialized");
+    if (_local) return *this;
 
-    return FermatExpression(fermat,_name+"#("+symbol+"="+repl._name+")");
+    string cmd = _name+"#("+symbol+"="+repl.term()+")";
+
+    if (fermat->memoizing()) {
+        string with = repl._local ? repl.term() : "@"+to_string(repl._version);
+
+        return memoized(cmd,"@"+to_string(_version)+"#("+symbol+"="+with+")");
+    }
+
+    return FermatExpression(fermat,cmd);
 }
 
 FermatExpression FermatExpression::subst(string symbol, int i) const {
     if (!fermat) throw invalid_argument("not initialized");
+    if (_local) return *this;
     stringstream strm;
 
     strm << _name << "#(" << symbol << "=" << i << ")";
 
+    if (fermat->memoizing()) {
+        return memoized(strm.str(),"@"+to_string(_version)+"#("+symbol+"="+to_string(i)+")");
+    }
+
     return FermatExpression(fermat,strm.str());
 }
 
+FermatExpression FermatExpression::subst(const map<string,FermatExpression> &repl) const {
+    if (!fermat) throw invalid_argument("not initialized");
+    if (_local || repl.empty()) return *this;
+
+    string cmd = _name+"#("+substList(repl)+")";
+
+    if (fermat->memoizing()) {
+        return memoized(cmd,"@"+to_string(_version)+"#("+substList(repl,true)+")");
+    }
+
+    return FermatExpression(fermat,cmd);
+}
+
+FermatExpression FermatExpression::subst(const map<string,int> &repl) const {
+    if (!fermat) throw invalid_argument("not initialized");
+    if (_local || repl.empty()) return *this;
+
+    string list = substList(repl);
+    string cmd = _name+"#("+list+")";
+
+    if (fermat->memoizing()) {
+        return memoized(cmd,"@"+to_string(_version)+"#("+list+")");
+    }
+
+    return FermatExpression(fermat,cmd);
+}
+
+string FermatExpression::substList(const map<string,FermatExpression> &repl, bool tagged) {
+    string list;
+
+    for (auto &r : repl) {
+        if (!r.second.fermat) throw invalid_argument("not initialized");
+
+        if (!list.empty()) list += ",";
+        list += r.first+"=";
+
+        if (tagged && !r.second._local) {
+            list += "@"+to_string(r.second._version);
+        } else {
+            list += r.second.term();
+        }
+    }
+
+    return list;
+}
+
+string FermatExpression::substList(const map<string,int> &repl) {
+    string list;
+
+    for (auto &r : repl) {
+        if (!list.empty()) list += ",";
+        list += r.first+"="+literal(FermatRational(r.second));
+    }
+
+    return list;
+}
+
 FermatExpression FermatExpression::deriv(string symbol, int n) const {
     if (!fermat) throw invalid_argument("not initialized");
+    if (_local) return n ? FermatExpression(fermat,0) : *this;
     stringstream strm;
     
     strm << "Deriv(" << _name << "," << symbol << "," << n << ")";
 
+    if (fermat->memoizing()) {
+        return memoized(strm.str(),"Deriv(@"+to_string(_version)+","+symbol+","+to_string(n)+")");
+    }
+
     return FermatExpression(fermat,strm.str());
 }
 
+FermatArray FermatExpression::gradient(const vector<string> &symbols) const {
+    if (!fermat) throw invalid_argument("not initialized");
+    if (symbols.empty()) throw invalid_argument("no symbols");
+
+    FermatArray g(fermat,1,(int)symbols.size());
+
+    if (_local) return g;
+
+    string cmd;
+
+    for (size_t j=0; j<symbols.size(); ++j) {
+        if (j) cmd += "; ";
+        cmd += g.name()+"[1,"+to_string(j+1)+"]:=Deriv("+_name+","+symbols[j]+",1)";
+    }
+
+    (*fermat)(cmd);
+    g.modified();
+
+    return g;
+}
+
+vector<string> FermatExpression::evalAt(const string &symbol, const vector<FermatRational> &points) const {
+    vector<vector<FermatRational>> values;
+
+    values.reserve(points.size());
+    for (auto &p : points) values.push_back(vector<FermatRational>(1,p));
+
+    return evalAt(vector<string>(1,symbol),values);
+}
+
+vector<string> FermatExpression::evalAt(const vector<string> &symbols, const vector<vector<FermatRational>> &points) const {
+    if (!fermat) throw invalid_argument("not initialized");
+
+    if (_local) return vector<string>(points.size(),_value.str());
+
+    vector<string> cmds;
+
+    cmds.reserve(points.size());
+
+    for (auto &p : points) {
+        if (p.size() != symbols.size()) throw invalid_argument("point does not match the symbols");
+
+        string cmd = _name+"#(";
+
+        for (size_t n=0; n<symbols.size(); ++n) {
+            if (n) cmd += ",";
+            cmd += symbols[n]+"="+literal(p[n]);
+        }
+        cmd += ")";
+
+        cmds.push_back(move(cmd));
+    }
+
+    vector<string> res = fermat->stripped(cmds);
+
+    for (auto &r : res) {
+        size_t pos = r.find(";or");
+        if (pos != string::npos) r.erase(pos);
+    }
+
+    return res;
+}
+
+vector<FermatRational> FermatExpression::valuesAt(const string &symbol, const vector<FermatRational> &points) const {
+    vector<vector<FermatRational>> values;
+
+    values.reserve(points.size());
+    for (auto &p : points) values.push_back(vector<FermatRational>(1,p));
+
+    return valuesAt(vector<string>(1,symbol),values);
+}
+
+vector<FermatRational> FermatExpression::valuesAt(const vector<string> &symbols, const vector<vector<FermatRational>> &points) const {
+    vector<string> texts = evalAt(symbols,points);
+    vector<FermatRational> res(texts.size());
+
+    for (size_t n=0; n<texts.size(); ++n) {
+        if (!FermatRational::parse(texts[n],res[n])) throw invalid_argument("not a number: "+texts[n]);
+    }
+
+    return res;
+}
+
+void FermatExpression::evaluate(const string &cmd, const string &key) {
+    string kept;
+    int rows, cols;
+    bool fresh = _name.empty();
+
+    if (fresh) _name = fermat->getUnique();
+
+    try {
+        if (key.empty()) {
+            (*fermat)(_name+":="+cmd);
+        } else if (fermat->memoFind(key,kept,rows,cols)) {
+            (*fermat)(_name+":="+kept);
+        } else {
+            // computed and kept in one go
+            kept = fermat->getUnique();
+
+            try {
+                (*fermat)(_name+":="+cmd+"; "+kept+":="+_name);
+            } catch (...) {
+                fermat->release(kept);
+                throw;
+            }
+
+            fermat->memoAdd(key,kept,false);
+        }
+    } catch (...) {
+        if (fresh) {
+            fermat->release(_name);
+            _name.clear();
+        }
+        throw;
+    }
+
+    modified();
+}
+
+FermatExpression FermatExpression::memoized(const string &cmd, const string &key) const {
+    FermatExpression n;
+
+    n.fermat = fermat;
+    n.evaluate(cmd,key);
+
+    return n;
+}
+
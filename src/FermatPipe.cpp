@@ -0,0 +1,375 @@
+// vim: set expandtab shiftwidth=4 tabstop=4:
+
+/*
+ *  src/FermatPipe.cpp
+ *
+ *  Copyright (C) 2017 Mario Prausa
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <FermatPipe.h>
+#include <FermatResponse.h>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <climits>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <sys/wait.h>
+using namespace std;
+
+FermatPipe::FermatPipe(size_t bufsize) {
+    if (bufsize == 0) throw invalid_argument("buffer size must be positive");
+
+    _pid = -1;
+    wfd = rfd = -1;
+
+    cap = bufsize;
+    buf = new char[cap];
+    head = count = 0;
+
+    deadline = chrono::steady_clock::time_point::max();
+    _timedOut = false;
+
+    resetStats();
+}
+
+FermatPipe::~FermatPipe() {
+    close();
+    delete[] buf;
+}
+
+bool FermatPipe::open(const string &cmd) {
+    int pin[2], pout[2];
+
+    close();
+
+    if (pipe2(pin,O_CLOEXEC)) return false;
+    if (pipe2(pout,O_CLOEXEC)) {
+        ::close(pin[0]);
+        ::close(pin[1]);
+        return false;
+    }
+
+    _pid = fork();
+
+    if (_pid < 0) {
+        ::close(pin[0]);
+        ::close(pin[1]);
+        ::close(pout[0]);
+        ::close(pout[1]);
+        return false;
+    }
+
+    if (_pid == 0) {
+        dup2(pin[0],STDIN_FILENO);
+        dup2(pout[1],STDOUT_FILENO);
+
+        string exec = "exec " + cmd;  // let the shell replace itself, so _pid is Fermat's pid
+        execl("/bin/sh","sh","-c",exec.c_str(),(char*)NULL);
+        _exit(127);
+    }
+
+    ::close(pin[0]);
+    ::close(pout[1]);
+
+    wfd = pin[1];
+    rfd = pout[0];
+
+    fcntl(wfd,F_SETFL,fcntl(wfd,F_GETFL)|O_NONBLOCK);
+    head = count = 0;
+
+    return true;
+}
+
+void FermatPipe::close() {
+    if (wfd >= 0) ::close(wfd);
+    if (rfd >= 0) ::close(rfd);
+    wfd = rfd = -1;
+
+    if (_pid > 0) {
+        while (waitpid(_pid,NULL,0) < 0 && errno == EINTR);
+    }
+    _pid = -1;
+    head = count = 0;
+}
+
+void FermatPipe::kill() {
+    if (_pid > 0) ::kill(_pid,SIGKILL);
+    close();
+}
+
+bool FermatPipe::isOpen() const {
+    return _pid > 0;
+}
+
+pid_t FermatPipe::pid() const {
+    return _pid;
+}
+
+bool FermatPipe::write(const string &line) {
+    return write(&line,1);
+}
+
+bool FermatPipe::write(const string *lines, size_t n) {
+    if (wfd < 0) return false;
+
+    static const char terminator[] = "\n\n";
+
+    vector<struct iovec> iov(2*n);
+
+    for (size_t i=0; i<n; ++i) {
+        iov[2*i].iov_base = const_cast<char*>(lines[i].data());
+        iov[2*i].iov_len = lines[i].size();
+        iov[2*i+1].iov_base = const_cast<char*>(terminator);
+        iov[2*i+1].iov_len = 2;
+    }
+
+    // a dead child must not kill us with SIGPIPE; block it for this thread and swallow it below.
+    sigset_t pipeset, oldset, pending;
+    sigemptyset(&pipeset);
+    sigaddset(&pipeset,SIGPIPE);
+    sigpending(&pending);
+    bool wasPending = sigismember(&pending,SIGPIPE);
+    pthread_sigmask(SIG_BLOCK,&pipeset,&oldset);
+
+    bool ok = true;
+
+    _stats.commands += n;
+    _stats.batches++;
+
+    for (size_t i=0; ok && i<iov.size(); i+=IOV_MAX) {
+        ok = writev(&iov[i],(int)min(iov.size()-i,(size_t)IOV_MAX));
+    }
+
+    if (!ok && errno == EPIPE && !wasPending) {
+        struct timespec zero = {0,0};
+        sigtimedwait(&pipeset,NULL,&zero);
+    }
+    pthread_sigmask(SIG_SETMASK,&oldset,NULL);
+
+    return ok;
+}
+
+bool FermatPipe::writev(struct iovec *v, int iovcnt) {
+    while (iovcnt) {
+        ssize_t n = ::writev(wfd,v,iovcnt);
+        _stats.writes++;
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+
+            // the child is blocked on its stdout, take its output before writing on.
+            struct pollfd fds[2];
+            fds[0].fd = wfd;
+            fds[0].events = POLLOUT;
+            fds[1].fd = rfd;
+            fds[1].events = POLLIN;
+
+            int ready = poll(fds,2,remaining());
+
+            if (ready < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            if (ready == 0) {
+                _timedOut = true;
+                return false;
+            }
+
+            if (fds[1].revents & (POLLIN|POLLHUP)) {
+                if (count == cap) grow();
+                if (!fill() && !(fds[0].revents & POLLOUT)) {
+                    errno = EPIPE;
+                    return false;
+                }
+            }
+            continue;
+        }
+
+        _stats.bytesWritten += n;
+
+        while (iovcnt && (size_t)n >= v->iov_len) {
+            n -= v->iov_len;
+            ++v;
+            --iovcnt;
+        }
+        if (iovcnt) {
+            v->iov_base = (char*)v->iov_base + n;
+            v->iov_len -= n;
+        }
+    }
+
+    return true;
+}
+
+void FermatPipe::grow() {
+    char *nbuf = new char[2*cap];
+    size_t len = min(count,cap-head);
+
+    memcpy(nbuf,buf+head,len);
+    memcpy(nbuf+len,buf,count-len);
+
+    delete[] buf;
+    buf = nbuf;
+    cap *= 2;
+    head = 0;
+}
+
+// milliseconds until the deadline for poll(), -1 without a deadline
+int FermatPipe::remaining() {
+    if (deadline == chrono::steady_clock::time_point::max()) return -1;
+
+    auto left = chrono::duration_cast<chrono::microseconds>(deadline-chrono::steady_clock::now()).count();
+
+    if (left <= 0) return 0;
+    return left/1000 >= INT_MAX ? INT_MAX : (int)((left+999)/1000);
+}
+
+bool FermatPipe::fill() {
+    if (rfd < 0 || count == cap) return false;
+
+    if (deadline != chrono::steady_clock::time_point::max()) {
+        struct pollfd fd;
+        int ready;
+
+        fd.fd = rfd;
+        fd.events = POLLIN;
+
+        do {
+            ready = poll(&fd,1,remaining());
+        } while (ready < 0 && errno == EINTR);
+
+        if (ready == 0) {
+            _timedOut = true;
+            return false;
+        }
+    }
+
+    size_t tail = (head+count)%cap;
+    struct iovec iov[2];
+    int iovcnt;
+
+    if (tail >= head) {
+        iov[0].iov_base = buf+tail;
+        iov[0].iov_len = cap-tail;
+        iov[1].iov_base = buf;
+        iov[1].iov_len = head;
+        iovcnt = head ? 2 : 1;
+    } else {
+        iov[0].iov_base = buf+tail;
+        iov[0].iov_len = head-tail;
+        iovcnt = 1;
+    }
+
+    ssize_t n;
+    do {
+        n = readv(rfd,iov,iovcnt);
+        _stats.reads++;
+    } while (n < 0 && errno == EINTR);
+
+    if (n <= 0) return false;
+
+    _stats.bytesRead += n;
+    count += n;
+
+    return true;
+}
+
+bool FermatPipe::getline(string &str) {
+    str.clear();
+
+    for (;;) {
+        if (count == 0) {
+            if (!fill()) return !str.empty();
+        }
+
+        size_t len = min(count,cap-head);
+        const char *p = buf+head;
+        const char *nl = (const char*)memchr(p,'\n',len);
+
+        if (nl) {
+            size_t n = nl-p;
+            str.append(p,n);
+            head = (head+n+1)%cap;
+            count -= n+1;
+            return true;
+        }
+
+        str.append(p,len);
+        head = (head+len)%cap;
+        count -= len;
+    }
+}
+
+bool FermatPipe::scan(FermatResponse &resp) {
+    while (!resp.done()) {
+        if (count == 0) {
+            if (!fill()) return false;
+        }
+
+        size_t len = min(count,cap-head);
+
+        size_t n = resp.feed(buf+head,len);
+
+        head = (head+n)%cap;
+        count -= n;
+    }
+
+    return true;
+}
+
+void FermatPipe::setDeadline(chrono::steady_clock::time_point deadline) {
+    this->deadline = deadline;
+    _timedOut = false;
+}
+
+bool FermatPipe::timedOut() const {
+    return _timedOut;
+}
+
+size_t FermatPipe::bufferSize() const {
+    return cap;
+}
+
+FermatPipe::Stats FermatPipe::stats() const {
+    Stats res;
+
+    res.bytesRead = _stats.bytesRead;
+    res.bytesWritten = _stats.bytesWritten;
+    res.reads = _stats.reads;
+    res.writes = _stats.writes;
+    res.commands = _stats.commands;
+    res.batches = _stats.batches;
+
+    return res;
+}
+
+void FermatPipe::resetStats() {
+    _stats.bytesRead = 0;
+    _stats.bytesWritten = 0;
+    _stats.reads = 0;
+    _stats.writes = 0;
+    _stats.commands = 0;
+    _stats.batches = 0;
+}
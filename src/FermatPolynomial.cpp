@@ -0,0 +1,170 @@
+// vim: set expandtab shiftwidth=4 tabstop=4:
+
+/*
+ *  src/FermatPolynomial.cpp
+ *
+ *  Copyright (C) 2017 Mario Prausa
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <FermatPolynomial.h>
+#include <stdexcept>
+#include <algorithm>
+#include <cctype>
+using namespace std;
+
+FermatPolynomial::FermatPolynomial() {
+}
+
+FermatPolynomial::FermatPolynomial(const vector<string> &symbols) : symbols(symbols) {
+}
+
+size_t FermatPolynomial::size() const {
+    return coefficients.size();
+}
+
+const FermatRational &FermatPolynomial::coefficient(size_t term) const {
+    return coefficients[term];
+}
+
+int FermatPolynomial::exponent(size_t term, size_t symbol) const {
+    return exponents[term*symbols.size()+symbol];
+}
+
+int FermatPolynomial::symbolIndex(const string &symbol) {
+    size_t n = find(symbols.begin(),symbols.end(),symbol)-symbols.begin();
+
+    if (n < symbols.size()) return (int)n;
+
+    // a new column: widen all rows
+    vector<int> widened;
+    size_t stride = symbols.size();
+
+    widened.reserve(size()*(stride+1));
+    for (size_t t=0; t<size(); ++t) {
+        widened.insert(widened.end(),exponents.begin()+t*stride,exponents.begin()+(t+1)*stride);
+        widened.push_back(0);
+    }
+
+    exponents.swap(widened);
+    symbols.push_back(symbol);
+
+    return (int)n;
+}
+
+void FermatPolynomial::addTerm(const FermatRational &coefficient, const int *exps) {
+    coefficients.push_back(coefficient);
+    exponents.insert(exponents.end(),exps,exps+symbols.size());
+}
+
+FermatPolynomial FermatPolynomial::parse(const string &text, const vector<string> &symbols) {
+    FermatPolynomial poly(symbols);
+    Parser parser(poly);
+
+    parser.put(text.data(),text.size());
+    parser.finish();
+
+    return poly;
+}
+
+FermatPolynomial::Parser::Parser(FermatPolynomial &poly) : poly(poly), coeff(1) {
+    number = power = started = negative = done = false;
+    symbol = -1;
+    exps.assign(poly.symbols.size(),0);
+}
+
+void FermatPolynomial::Parser::put(const char *data, size_t len) {
+    for (size_t n=0; n<len && !done; ++n) {
+        char ch = data[n];
+
+        if (isdigit((unsigned char)ch) || (ch == '/' && number)) {
+            if (tok.empty()) number = true;
+            tok += ch;
+        } else if (isalpha((unsigned char)ch) || ch == '_') {
+            if (number && !tok.empty()) throw invalid_argument("cannot parse polynomial: missing '*'");
+            tok += ch;
+        } else if (isspace((unsigned char)ch) || ch == '`') {
+            continue;
+        } else {
+            token();
+
+            switch (ch) {
+                case '*':
+                    break;
+                case '^':
+                    if (symbol < 0) throw invalid_argument("cannot parse polynomial: '^' without a symbol");
+                    power = true;
+                    break;
+                case '+':
+                case '-':
+                    term();
+                    negative = ch == '-';
+                    break;
+                case ';':
+                    done = true;
+                    break;
+                default:
+                    throw invalid_argument(string("cannot parse polynomial: unexpected '")+ch+"'");
+            }
+        }
+    }
+}
+
+void FermatPolynomial::Parser::finish() {
+    token();
+    term();
+}
+
+// a complete factor: coefficient, symbol or exponent
+void FermatPolynomial::Parser::token() {
+    if (tok.empty()) return;
+
+    if (number) {
+        FermatRational num;
+
+        if (!FermatRational::parse(tok,num)) throw invalid_argument("cannot parse polynomial: bad number "+tok);
+
+        if (power) {
+            if (!num.isInteger() || !num.numer().fitsInt()) throw invalid_argument("cannot parse polynomial: bad exponent "+tok);
+            exps[symbol] += (int)num.numer().toInt()-1;
+            power = false;
+        } else {
+            coeff *= num;
+        }
+    } else {
+        symbol = poly.symbolIndex(tok);
+        if ((size_t)symbol >= exps.size()) exps.resize(poly.symbols.size(),0);
+        exps[symbol]++;
+    }
+
+    started = true;
+    number = false;
+    tok.clear();
+}
+
+void FermatPolynomial::Parser::term() {
+    if (!started) return;
+    if (power) throw invalid_argument("cannot parse polynomial: missing exponent");
+
+    if (!coeff.isZero()) {
+        exps.resize(poly.symbols.size(),0);
+        poly.addTerm(negative ? -coeff : coeff,exps.data());
+    }
+
+    coeff = FermatRational(1);
+    exps.assign(poly.symbols.size(),0);
+    started = negative = false;
+    symbol = -1;
+}
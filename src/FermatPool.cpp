@@ -0,0 +1,204 @@
+// vim: set expandtab shiftwidth=4 tabstop=4:
+
+/*
+ *  src/FermatPool.cpp
+ *
+ *  Copyright (C) 2017 Mario Prausa
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <FermatPool.h>
+#include <stdexcept>
+#include <exception>
+using namespace std;
+
+FermatPool::FermatPool(string path, int n, bool verbose) {
+    if (n <= 0) n = thread::hardware_concurrency();
+    if (n <= 0) n = 1;
+
+    stealable = outstanding = 0;
+    stopping = false;
+    next = 0;
+
+    for (int i=0; i<n; ++i) {
+        workers.emplace_back(new Worker);
+        workers.back()->npinned = 0;
+    }
+
+    // start the processes in parallel, every constructor runs Fermat's startup check.
+    vector<thread> starters;
+    vector<exception_ptr> errors(n);
+
+    for (int i=0; i<n; ++i) {
+        starters.emplace_back([this,i,&path,verbose,&errors] {
+            try {
+                workers[i]->fermat.reset(new Fermat(path,verbose));
+            } catch (...) {
+                errors[i] = current_exception();
+            }
+        });
+    }
+
+    for (auto &t : starters) t.join();
+
+    for (auto &e : errors) {
+        if (e) rethrow_exception(e);
+    }
+
+    for (int i=0; i<n; ++i) {
+        workers[i]->thr = thread(&FermatPool::run,this,i);
+    }
+}
+
+FermatPool::~FermatPool() {
+    {
+        lock_guard<mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+
+    for (auto &w : workers) {
+        w->thr.join();
+    }
+}
+
+int FermatPool::size() const {
+    return workers.size();
+}
+
+void FermatPool::addSymbol(string sym) {
+    vector<future<void>> res;
+
+    for (int i=0; i<size(); ++i) {
+        res.push_back(submitTo(i,[sym](Fermat &fermat) { fermat.addSymbol(sym); }));
+    }
+
+    for (auto &r : res) r.get();
+}
+
+void FermatPool::dropSymbol(string sym) {
+    vector<future<void>> res;
+
+    for (int i=0; i<size(); ++i) {
+        res.push_back(submitTo(i,[sym](Fermat &fermat) { fermat.dropSymbol(sym); }));
+    }
+
+    for (auto &r : res) r.get();
+}
+
+future<string> FermatPool::submit(string cmd) {
+    return submit([cmd](Fermat &fermat) { return fermat(cmd); });
+}
+
+void FermatPool::wait() {
+    unique_lock<mutex> lock(mtx);
+
+    idle.wait(lock,[this] { return outstanding == 0; });
+}
+
+void FermatPool::post(Job job, int pin) {
+    if (pin >= size()) throw invalid_argument("no such worker");
+
+    int n = pin >= 0 ? pin : (int)(next++ % workers.size());
+    Worker &w = *workers[n];
+
+    // counted before it is visible, so a worker taking and finishing the
+    // job right away cannot bring the counters below the real number.
+    {
+        lock_guard<mutex> lock(mtx);
+        if (pin >= 0) {
+            w.npinned++;
+        } else {
+            stealable++;
+        }
+        outstanding++;
+    }
+
+    {
+        lock_guard<mutex> lock(w.mtx);
+        if (pin >= 0) {
+            w.pinned.push_back(move(job));
+        } else {
+            w.jobs.push_back(move(job));
+        }
+    }
+
+    cv.notify_all();
+}
+
+bool FermatPool::take(int n, Job &job) {
+    Worker &w = *workers[n];
+    bool pinned = false;
+    bool found = false;
+
+    {
+        lock_guard<mutex> lock(w.mtx);
+
+        if (!w.pinned.empty()) {
+            job = move(w.pinned.front());
+            w.pinned.pop_front();
+            pinned = found = true;
+        } else if (!w.jobs.empty()) {
+            job = move(w.jobs.front());
+            w.jobs.pop_front();
+            found = true;
+        }
+    }
+
+    // nothing left of our own, steal the most recently queued job of another worker.
+    for (size_t k=1; !found && k<workers.size(); ++k) {
+        Worker &v = *workers[(n+k)%workers.size()];
+        lock_guard<mutex> lock(v.mtx);
+
+        if (!v.jobs.empty()) {
+            job = move(v.jobs.back());
+            v.jobs.pop_back();
+            found = true;
+        }
+    }
+
+    if (found) {
+        lock_guard<mutex> lock(mtx);
+        if (pinned) {
+            w.npinned--;
+        } else {
+            stealable--;
+        }
+    }
+
+    return found;
+}
+
+void FermatPool::run(int n) {
+    Worker &w = *workers[n];
+    Job job;
+
+    for (;;) {
+        if (take(n,job)) {
+            job(*w.fermat);
+            job = nullptr;
+
+            lock_guard<mutex> lock(mtx);
+            if (--outstanding == 0) idle.notify_all();
+            continue;
+        }
+
+        unique_lock<mutex> lock(mtx);
+        if (stealable == 0 && w.npinned == 0) {
+            if (stopping) return;
+            cv.wait(lock,[this,&w] { return stopping || stealable > 0 || w.npinned > 0; });
+        }
+    }
+}
@@ -0,0 +1,505 @@
+// vim: set expandtab shiftwidth=4 tabstop=4:
+
+/*
+ *  src/FermatRational.cpp
+ *
+ *  Copyright (C) 2017 Mario Prausa
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <FermatRational.h>
+#include <stdexcept>
+#include <algorithm>
+using namespace std;
+
+FermatInteger::FermatInteger() {
+    neg = false;
+}
+
+FermatInteger::FermatInteger(long long i) {
+    neg = i < 0;
+
+    unsigned long long u = neg ? 0ULL-(unsigned long long)i : (unsigned long long)i;
+
+    while (u) {
+        mag.push_back((uint32_t)u);
+        u >>= 32;
+    }
+}
+
+bool FermatInteger::parse(const string &str, FermatInteger &res) {
+    size_t pos = 0;
+    bool negative = false;
+
+    if (pos < str.size() && (str[pos] == '-' || str[pos] == '+')) {
+        negative = str[pos] == '-';
+        ++pos;
+    }
+
+    if (pos == str.size()) return false;
+
+    res = FermatInteger();
+
+    while (pos < str.size()) {
+        uint32_t chunk = 0;
+        uint32_t scale = 1;
+
+        for (int n=0; n<9 && pos<str.size(); ++n, ++pos) {
+            if (str[pos] < '0' || str[pos] > '9') return false;
+            chunk = chunk*10 + (str[pos]-'0');
+            scale *= 10;
+        }
+
+        uint64_t carry = chunk;
+        for (auto &l : res.mag) {
+            uint64_t t = (uint64_t)l*scale + carry;
+            l = (uint32_t)t;
+            carry = t >> 32;
+        }
+        if (carry) res.mag.push_back((uint32_t)carry);
+    }
+
+    res.trim();
+    res.neg = negative && !res.mag.empty();
+
+    return true;
+}
+
+string FermatInteger::str() const {
+    if (mag.empty()) return "0";
+
+    vector<uint32_t> tmp = mag;
+    vector<uint32_t> chunks;
+
+    while (!tmp.empty()) {
+        chunks.push_back(divSmall(tmp,1000000000));
+    }
+
+    string res = neg ? "-" : "";
+    res += to_string(chunks.back());
+
+    for (size_t n=chunks.size()-1; n-- > 0;) {
+        string c = to_string(chunks[n]);
+        res += string(9-c.size(),'0') + c;
+    }
+
+    return res;
+}
+
+bool FermatInteger::isZero() const {
+    return mag.empty();
+}
+
+bool FermatInteger::isNegative() const {
+    return neg;
+}
+
+bool FermatInteger::isOne() const {
+    return !neg && mag.size() == 1 && mag[0] == 1;
+}
+
+bool FermatInteger::fitsInt() const {
+    if (mag.size() > 2) return false;
+    if (mag.size() < 2) return true;
+    return mag[1] < 0x80000000u;
+}
+
+long long FermatInteger::toInt() const {
+    unsigned long long u = 0;
+
+    if (mag.size() > 0) u |= mag[0];
+    if (mag.size() > 1) u |= (unsigned long long)mag[1] << 32;
+
+    return neg ? -(long long)u : (long long)u;
+}
+
+int FermatInteger::sign() const {
+    if (mag.empty()) return 0;
+    return neg ? -1 : 1;
+}
+
+FermatInteger FermatInteger::abs() const {
+    FermatInteger res = *this;
+    res.neg = false;
+    return res;
+}
+
+FermatInteger FermatInteger::operator-() const {
+    FermatInteger res = *this;
+    if (!res.mag.empty()) res.neg = !neg;
+    return res;
+}
+
+FermatInteger FermatInteger::operator+(const FermatInteger &other) const {
+    FermatInteger res;
+
+    if (neg == other.neg) {
+        res.mag = addMag(mag,other.mag);
+        res.neg = neg;
+    } else if (cmpMag(mag,other.mag) >= 0) {
+        res.mag = subMag(mag,other.mag);
+        res.neg = neg;
+    } else {
+        res.mag = subMag(other.mag,mag);
+        res.neg = other.neg;
+    }
+
+    res.trim();
+    if (res.mag.empty()) res.neg = false;
+
+    return res;
+}
+
+FermatInteger FermatInteger::operator-(const FermatInteger &other) const {
+    return *this + (-other);
+}
+
+FermatInteger FermatInteger::operator*(const FermatInteger &other) const {
+    FermatInteger res;
+
+    res.mag = mulMag(mag,other.mag);
+    res.trim();
+    res.neg = !res.mag.empty() && neg != other.neg;
+
+    return res;
+}
+
+FermatInteger FermatInteger::operator/(const FermatInteger &other) const {
+    FermatInteger q, r;
+    divmod(*this,other,q,r);
+    return q;
+}
+
+FermatInteger FermatInteger::operator%(const FermatInteger &other) const {
+    FermatInteger q, r;
+    divmod(*this,other,q,r);
+    return r;
+}
+
+FermatInteger &FermatInteger::operator+=(const FermatInteger &other) {
+    return *this = *this + other;
+}
+
+FermatInteger &FermatInteger::operator-=(const FermatInteger &other) {
+    return *this = *this - other;
+}
+
+FermatInteger &FermatInteger::operator*=(const FermatInteger &other) {
+    return *this = *this * other;
+}
+
+bool FermatInteger::operator==(const FermatInteger &other) const {
+    return neg == other.neg && mag == other.mag;
+}
+
+bool FermatInteger::operator!=(const FermatInteger &other) const {
+    return !(*this == other);
+}
+
+bool FermatInteger::operator<(const FermatInteger &other) const {
+    if (neg != other.neg) return neg;
+
+    int c = cmpMag(mag,other.mag);
+
+    return neg ? c > 0 : c < 0;
+}
+
+void FermatInteger::divmod(const FermatInteger &a, const FermatInteger &b, FermatInteger &q, FermatInteger &r) {
+    if (b.mag.empty()) throw domain_error("division by zero");
+
+    divMag(a.mag,b.mag,q.mag,r.mag);
+    q.trim();
+    r.trim();
+
+    q.neg = !q.mag.empty() && a.neg != b.neg;
+    r.neg = !r.mag.empty() && a.neg;
+}
+
+FermatInteger FermatInteger::gcd(FermatInteger a, FermatInteger b) {
+    a.neg = b.neg = false;
+
+    while (!b.isZero()) {
+        FermatInteger t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+void FermatInteger::trim() {
+    while (!mag.empty() && mag.back() == 0) mag.pop_back();
+}
+
+int FermatInteger::cmpMag(const vector<uint32_t> &a, const vector<uint32_t> &b) {
+    if (a.size() != b.size()) return a.size() < b.size() ? -1 : 1;
+
+    for (size_t n=a.size(); n-- > 0;) {
+        if (a[n] != b[n]) return a[n] < b[n] ? -1 : 1;
+    }
+
+    return 0;
+}
+
+vector<uint32_t> FermatInteger::addMag(const vector<uint32_t> &a, const vector<uint32_t> &b) {
+    const vector<uint32_t> &x = a.size() >= b.size() ? a : b;
+    const vector<uint32_t> &y = a.size() >= b.size() ? b : a;
+    vector<uint32_t> res(x.size()+1);
+    uint64_t carry = 0;
+
+    for (size_t n=0; n<x.size(); ++n) {
+        uint64_t t = (uint64_t)x[n] + (n<y.size() ? y[n] : 0) + carry;
+        res[n] = (uint32_t)t;
+        carry = t >> 32;
+    }
+    res[x.size()] = (uint32_t)carry;
+
+    return res;
+}
+
+vector<uint32_t> FermatInteger::subMag(const vector<uint32_t> &a, const vector<uint32_t> &b) {
+    vector<uint32_t> res(a.size());
+    int64_t borrow = 0;
+
+    for (size_t n=0; n<a.size(); ++n) {
+        int64_t t = (int64_t)a[n] - (n<b.size() ? b[n] : 0) - borrow;
+        borrow = t < 0;
+        res[n] = (uint32_t)(t + (borrow << 32));
+    }
+
+    return res;
+}
+
+vector<uint32_t> FermatInteger::mulMag(const vector<uint32_t> &a, const vector<uint32_t> &b) {
+    if (a.empty() || b.empty()) return vector<uint32_t>();
+
+    vector<uint32_t> res(a.size()+b.size());
+
+    for (size_t i=0; i<a.size(); ++i) {
+        uint64_t carry = 0;
+        for (size_t j=0; j<b.size(); ++j) {
+            uint64_t t = (uint64_t)a[i]*b[j] + res[i+j] + carry;
+            res[i+j] = (uint32_t)t;
+            carry = t >> 32;
+        }
+        res[i+b.size()] = (uint32_t)carry;
+    }
+
+    return res;
+}
+
+uint32_t FermatInteger::divSmall(vector<uint32_t> &a, uint32_t d) {
+    uint64_t rem = 0;
+
+    for (size_t n=a.size(); n-- > 0;) {
+        uint64_t t = (rem << 32) | a[n];
+        a[n] = (uint32_t)(t/d);
+        rem = t%d;
+    }
+
+    while (!a.empty() && a.back() == 0) a.pop_back();
+
+    return (uint32_t)rem;
+}
+
+// Knuth, TAOCP Vol. 2, Algorithm D
+void FermatInteger::divMag(const vector<uint32_t> &a, const vector<uint32_t> &b, vector<uint32_t> &q, vector<uint32_t> &r) {
+    if (cmpMag(a,b) < 0) {
+        q.clear();
+        r = a;
+        return;
+    }
+
+    if (b.size() == 1) {
+        q = a;
+        uint32_t rem = divSmall(q,b[0]);
+        r.clear();
+        if (rem) r.push_back(rem);
+        return;
+    }
+
+    size_t n = b.size();
+    size_t m = a.size()-n;
+    int s = __builtin_clz(b.back());
+
+    vector<uint32_t> bn(n), an(a.size()+1);
+
+    for (size_t i=n-1; i>0; --i) {
+        bn[i] = (b[i] << s) | (s ? (uint32_t)((uint64_t)b[i-1] >> (32-s)) : 0);
+    }
+    bn[0] = b[0] << s;
+
+    an[a.size()] = s ? (uint32_t)((uint64_t)a.back() >> (32-s)) : 0;
+    for (size_t i=a.size()-1; i>0; --i) {
+        an[i] = (a[i] << s) | (s ? (uint32_t)((uint64_t)a[i-1] >> (32-s)) : 0);
+    }
+    an[0] = a[0] << s;
+
+    q.assign(m+1,0);
+
+    for (size_t j=m+1; j-- > 0;) {
+        uint64_t num = ((uint64_t)an[j+n] << 32) | an[j+n-1];
+        uint64_t qhat = num/bn[n-1];
+        uint64_t rhat = num%bn[n-1];
+
+        while (qhat >= (1ULL<<32) || qhat*bn[n-2] > ((rhat << 32) | an[j+n-2])) {
+            --qhat;
+            rhat += bn[n-1];
+            if (rhat >= (1ULL<<32)) break;
+        }
+
+        int64_t k = 0, t;
+        for (size_t i=0; i<n; ++i) {
+            uint64_t p = qhat*bn[i];
+            t = (int64_t)an[i+j] - k - (int64_t)(p & 0xFFFFFFFFULL);
+            an[i+j] = (uint32_t)t;
+            k = (int64_t)(p >> 32) - (t >> 32);
+        }
+        t = (int64_t)an[j+n] - k;
+        an[j+n] = (uint32_t)t;
+
+        q[j] = (uint32_t)qhat;
+
+        if (t < 0) {
+            --q[j];
+            uint64_t carry = 0;
+            for (size_t i=0; i<n; ++i) {
+                uint64_t u = (uint64_t)an[i+j] + bn[i] + carry;
+                an[i+j] = (uint32_t)u;
+                carry = u >> 32;
+            }
+            an[j+n] += (uint32_t)carry;
+        }
+    }
+
+    r.assign(n,0);
+    for (size_t i=0; i<n; ++i) {
+        r[i] = (an[i] >> s) | (s ? (uint32_t)((uint64_t)an[i+1] << (32-s)) : 0);
+    }
+}
+
+FermatRational::FermatRational() : num(0), den(1) {}
+
+FermatRational::FermatRational(long long i) : num(i), den(1) {}
+
+FermatRational::FermatRational(const FermatInteger &num, const FermatInteger &den) : num(num), den(den) {
+    if (den.isZero()) throw domain_error("division by zero");
+    normalize();
+}
+
+bool FermatRational::parse(const string &str, FermatRational &res) {
+    size_t pos = str.find('/');
+    FermatInteger n, d(1);
+
+    if (!FermatInteger::parse(str.substr(0,pos),n)) return false;
+    if (pos != string::npos) {
+        if (!FermatInteger::parse(str.substr(pos+1),d) || d.isZero()) return false;
+    }
+
+    res = FermatRational(n,d);
+
+    return true;
+}
+
+string FermatRational::str() const {
+    if (den.isOne()) return num.str();
+    return num.str() + "/" + den.str();
+}
+
+const FermatInteger &FermatRational::numer() const {
+    return num;
+}
+
+const FermatInteger &FermatRational::denom() const {
+    return den;
+}
+
+bool FermatRational::isZero() const {
+    return num.isZero();
+}
+
+bool FermatRational::isInteger() const {
+    return den.isOne();
+}
+
+int FermatRational::sign() const {
+    return num.sign();
+}
+
+FermatRational FermatRational::operator-() const {
+    FermatRational res = *this;
+    res.num = -num;
+    return res;
+}
+
+FermatRational FermatRational::operator+(const FermatRational &other) const {
+    if (den == other.den) return FermatRational(num+other.num,den);
+    return FermatRational(num*other.den + other.num*den,den*other.den);
+}
+
+FermatRational FermatRational::operator-(const FermatRational &other) const {
+    return *this + (-other);
+}
+
+FermatRational FermatRational::operator*(const FermatRational &other) const {
+    return FermatRational(num*other.num,den*other.den);
+}
+
+FermatRational FermatRational::operator/(const FermatRational &other) const {
+    if (other.num.isZero()) throw domain_error("division by zero");
+    return FermatRational(num*other.den,den*other.num);
+}
+
+FermatRational &FermatRational::operator+=(const FermatRational &other) {
+    return *this = *this + other;
+}
+
+FermatRational &FermatRational::operator-=(const FermatRational &other) {
+    return *this = *this - other;
+}
+
+FermatRational &FermatRational::operator*=(const FermatRational &other) {
+    return *this = *this * other;
+}
+
+bool FermatRational::operator==(const FermatRational &other) const {
+    return num == other.num && den == other.den;
+}
+
+bool FermatRational::operator!=(const FermatRational &other) const {
+    return !(*this == other);
+}
+
+bool FermatRational::operator<(const FermatRational &other) const {
+    return num*other.den < other.num*den;
+}
+
+void FermatRational::normalize() {
+    if (den.isNegative()) {
+        num = -num;
+        den = -den;
+    }
+
+    if (den.isOne()) return;
+
+    FermatInteger g = FermatInteger::gcd(num,den);
+
+    if (!g.isOne() && !g.isZero()) {
+        num = num/g;
+        den = den/g;
+    }
+
+    if (num.isZero()) den = FermatInteger(1);
+}
@@ -0,0 +1,131 @@
+// vim: set expandtab shiftwidth=4 tabstop=4:
+
+/*
+ *  src/FermatResponse.cpp
+ *
+ *  Copyright (C) 2017 Mario Prausa
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <FermatResponse.h>
+#include <cctype>
+using namespace std;
+
+FermatResponse::FermatResponse(bool strip, Sink *sink) : strip(strip), sink(sink) {
+    _done = _error = pending = false;
+    first = true;
+    column = text = 0;
+    stars = 0;
+    _consumed = 0;
+}
+
+size_t FermatResponse::feed(const char *data, size_t len) {
+    size_t n = 0;
+
+    while (n < len && !_done) {
+        char c = data[n++];
+
+        if (c == '\n') {
+            if (column) {
+                if (pending && text == 1) {
+                    _done = true;       // the prompt line
+                    break;
+                }
+                if (onLine) {
+                    onLine(line);
+                    line.clear();
+                }
+            }
+            column = text = 0;
+            continue;
+        }
+
+        if (column++ == 0 && first) {
+            first = false;
+            if (c == '>') continue;     // echoed prompt
+        }
+
+        if (text++ == 0 && c == '>') {
+            pending = true;
+            continue;
+        }
+
+        if (pending) {
+            pending = false;
+            emit('>');
+        }
+
+        emit(c);
+    }
+
+    _consumed += n;
+
+    // the response goes on past the chunk: expect at least as much again
+    if (!_done && !sink && out.size()+_consumed > out.capacity()) out.reserve(out.size()+_consumed);
+
+    if (sink && !out.empty()) {
+        try {
+            if (!_error) sink->put(out.data(),out.size());
+        } catch (...) {
+            // the response still has to be read to the end
+            _sinkError = current_exception();
+            sink = NULL;
+        }
+        out.clear();
+    }
+
+    return n;
+}
+
+void FermatResponse::emit(char c) {
+    if (c == '*') {
+        if (++stars >= 3) _error = true;
+    } else {
+        stars = 0;
+    }
+
+    if (strip || sink) {
+        if (_head.size() < headSize) _head += c;
+        if (!isspace((unsigned char)c)) out += c;
+    } else {
+        out += c;
+    }
+
+    if (onLine) line += c;
+}
+
+bool FermatResponse::done() const {
+    return _done;
+}
+
+bool FermatResponse::error() const {
+    return _error;
+}
+
+size_t FermatResponse::consumed() const {
+    return _consumed;
+}
+
+string &FermatResponse::output() {
+    return out;
+}
+
+const string &FermatResponse::head() const {
+    return (strip || sink) ? _head : out;
+}
+
+exception_ptr FermatResponse::sinkError() const {
+    return _sinkError;
+}
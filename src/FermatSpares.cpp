@@ -0,0 +1,107 @@
+// vim: set expandtab shiftwidth=4 tabstop=4:
+
+/*
+ *  src/FermatSpares.cpp
+ *
+ *  Copyright (C) 2017 Mario Prausa
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <FermatSpares.h>
+using namespace std;
+
+FermatSpares::FermatSpares(string path, int count, vector<string> symbols, bool verbose)
+    : path(path), count(count), symbols(symbols), verbose(verbose) {
+    stopping = false;
+    thr = thread(&FermatSpares::run,this);
+}
+
+FermatSpares::~FermatSpares() {
+    {
+        lock_guard<mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    thr.join();
+}
+
+unique_ptr<Fermat> FermatSpares::start() const {
+    unique_ptr<Fermat> fermat(new Fermat(path,verbose));
+
+    for (auto &sym : symbols) fermat->addSymbol(sym);
+
+    return fermat;
+}
+
+unique_ptr<Fermat> FermatSpares::acquire() {
+    {
+        lock_guard<mutex> lock(mtx);
+
+        if (!spares.empty()) {
+            unique_ptr<Fermat> fermat = move(spares.front());
+            spares.pop_front();
+            cv.notify_all();
+            return fermat;
+        }
+
+        // the background start failed: report it, the next call tries again
+        if (error) {
+            exception_ptr failed = error;
+            error = exception_ptr();
+            cv.notify_all();
+            rethrow_exception(failed);
+        }
+    }
+
+    return start();
+}
+
+int FermatSpares::ready() {
+    lock_guard<mutex> lock(mtx);
+    return spares.size();
+}
+
+void FermatSpares::run() {
+    unique_lock<mutex> lock(mtx);
+
+    for (;;) {
+        cv.wait(lock,[this] { return stopping || (!error && (int)spares.size() < count); });
+        if (stopping) break;
+
+        lock.unlock();
+
+        unique_ptr<Fermat> fermat;
+        exception_ptr failed;
+
+        try {
+            fermat = start();
+        } catch (...) {
+            failed = current_exception();
+        }
+
+        lock.lock();
+
+        if (fermat) {
+            spares.push_back(move(fermat));
+        } else {
+            error = failed;
+        }
+    }
+
+    // the spares quit their processes outside the lock
+    deque<unique_ptr<Fermat>> rest;
+    rest.swap(spares);
+    lock.unlock();
+}
@@ -0,0 +1,127 @@
+// vim: set expandtab shiftwidth=4 tabstop=4:
+
+/*
+ *  src/FermatStats.cpp
+ *
+ *  Copyright (C) 2017 Mario Prausa
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <FermatStats.h>
+#include <cstring>
+#include <cmath>
+using namespace std;
+
+FermatStats::FermatStats() {
+    reset();
+}
+
+FermatStats::Kind FermatStats::classify(const string &cmd) {
+    static const struct {
+        const char *token;
+        Kind kind;
+    } functions[] = {
+        {"Det[",Det},
+        {"Trans[",Trans},
+        {"1/[",Inverse},
+        {"Colreduce(",Colreduce},
+        {"Redrowech(",Redrowech},
+        {"Chpoly(",Chpoly},
+        {"Iszero[",Iszero},
+        {"Deriv(",Deriv},
+        {"#(",Subst},
+        {"Deg(",Degree},
+        {"Codeg(",Degree},
+        {NULL,Print}
+    };
+
+    if (cmd.empty()) return Print;
+    if (cmd[0] == '@') return Deletion;
+    if (cmd[0] == '&') return Setting;
+    if (cmd.compare(0,6,"Array ") == 0) return Declaration;
+
+    for (int n=0; functions[n].token; ++n) {
+        if (cmd.find(functions[n].token) != string::npos) return functions[n].kind;
+    }
+
+    if (cmd.find(":=") != string::npos) return Assignment;
+
+    return Print;
+}
+
+const char *FermatStats::name(Kind kind) {
+    static const char *names[] = {
+        "assignment","deletion","declaration","setting","print","Det","Trans","inverse",
+        "Colreduce","Redrowech","Chpoly","Iszero","Deriv","subst","Deg"
+    };
+
+    return kind < NumKinds ? names[kind] : "total";
+}
+
+void FermatStats::record(Kind kind, double us, size_t written, size_t read, bool error) {
+    Entry &e = entries[kind];
+    int bucket = 0;
+
+    e.count++;
+    if (error) e.errors++;
+    e.bytesWritten += written;
+    e.bytesRead += read;
+    e.time += us;
+
+    for (uint64_t t = (uint64_t)us+1; t > 1 && bucket < buckets-1; t >>= 1) ++bucket;
+    e.histogram[bucket]++;
+}
+
+void FermatStats::reset() {
+    memset(entries,0,sizeof(entries));
+}
+
+const FermatStats::Entry &FermatStats::operator[](Kind kind) const {
+    return entries[kind];
+}
+
+FermatStats::Entry FermatStats::total() const {
+    Entry t;
+
+    memset(&t,0,sizeof(t));
+
+    for (auto &e : entries) {
+        t.count += e.count;
+        t.errors += e.errors;
+        t.bytesWritten += e.bytesWritten;
+        t.bytesRead += e.bytesRead;
+        t.time += e.time;
+        for (int n=0; n<buckets; ++n) t.histogram[n] += e.histogram[n];
+    }
+
+    return t;
+}
+
+// upper bound of the histogram bucket containing the p-quantile
+double FermatStats::percentile(Kind kind, double p) const {
+    const Entry &e = entries[kind];
+    uint64_t seen = 0;
+    uint64_t target = (uint64_t)ceil(p*e.count);
+
+    if (!e.count) return 0;
+    if (target == 0) target = 1;
+
+    for (int n=0; n<buckets; ++n) {
+        seen += e.histogram[n];
+        if (seen >= target) return ldexp(1.0,n+1)-1;
+    }
+
+    return ldexp(1.0,buckets)-1;
+}
@@ -0,0 +1,127 @@
+// vim: set expandtab shiftwidth=4 tabstop=4:
+
+/*
+ *  src/FermatTrace.cpp
+ *
+ *  Copyright (C) 2017 Mario Prausa
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <FermatTrace.h>
+#include <stdexcept>
+#include <cstring>
+#include <chrono>
+using namespace std;
+
+const char FermatTrace::magic[8] = {'F','E','R','M','T','R','C','1'};
+
+FermatTrace::FermatTrace(const string &path, size_t capacity) : head(0), tail(0), _dropped(0), stopping(false) {
+    cap = 4096;
+    while (cap < capacity) cap <<= 1;
+
+    file = fopen(path.c_str(),"wb");
+    if (!file) {
+        throw invalid_argument("cannot open trace file "+path);
+    }
+
+    fwrite(magic,1,sizeof(magic),file);
+
+    buf = new char[cap];
+    writer = thread(&FermatTrace::run,this);
+}
+
+FermatTrace::~FermatTrace() {
+    stopping = true;
+    writer.join();
+
+    fclose(file);
+    delete[] buf;
+}
+
+void FermatTrace::put(const void *data, size_t n, size_t pos) {
+    size_t off = pos & (cap-1);
+    size_t first = n < cap-off ? n : cap-off;
+
+    memcpy(buf+off,data,first);
+    memcpy(buf,(const char*)data+first,n-first);
+}
+
+void FermatTrace::record(const string &cmd, uint64_t time, uint32_t duration, uint32_t read, uint8_t kind, bool error) {
+    Record rec;
+    size_t len = cmd.size() < maxCommand ? cmd.size() : maxCommand;
+    size_t h = head.load(memory_order_relaxed);
+
+    if (sizeof(rec)+len > cap - (h - tail.load(memory_order_acquire))) {
+        _dropped.fetch_add(1,memory_order_relaxed);
+        return;
+    }
+
+    rec.time = time;
+    rec.duration = duration;
+    rec.written = (uint32_t)cmd.size();
+    rec.read = read;
+    rec.length = (uint16_t)len;
+    rec.kind = kind;
+    rec.flags = (error ? Error : 0) | (len < cmd.size() ? Truncated : 0);
+
+    put(&rec,sizeof(rec),h);
+    put(cmd.data(),len,h+sizeof(rec));
+
+    head.store(h+sizeof(rec)+len,memory_order_release);
+}
+
+uint64_t FermatTrace::dropped() const {
+    return _dropped.load(memory_order_relaxed);
+}
+
+void FermatTrace::run() {
+    for (;;) {
+        // read stopping first, so that everything recorded before is written out.
+        bool last = stopping.load();
+        size_t t = tail.load(memory_order_relaxed);
+        size_t h = head.load(memory_order_acquire);
+
+        if (h == t) {
+            if (last) break;
+
+            fflush(file);
+            this_thread::sleep_for(chrono::milliseconds(2));
+            continue;
+        }
+
+        size_t off = t & (cap-1);
+        size_t n = h-t < cap-off ? h-t : cap-off;
+
+        fwrite(buf+off,1,n,file);
+        tail.store(t+n,memory_order_release);
+    }
+
+    fflush(file);
+}
+
+bool FermatTrace::readHeader(FILE *file) {
+    char str[sizeof(magic)];
+
+    return fread(str,1,sizeof(str),file) == sizeof(str) && memcmp(str,magic,sizeof(magic)) == 0;
+}
+
+bool FermatTrace::read(FILE *file, Record &rec, string &cmd) {
+    if (fread(&rec,sizeof(rec),1,file) != 1) return false;
+
+    cmd.resize(rec.length);
+    if (rec.length && fread(&cmd[0],1,rec.length,file) != rec.length) return false;
+
+    return true;
+}
@@ -0,0 +1,58 @@
+// vim: set expandtab shiftwidth=4 tabstop=4:
+
+/*
+ *  test/local_deg.cpp
+ *
+ *  Copyright (C) 2017 Mario Prausa
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// degrees of a constant held in the process agree with those of Fermat
+
+#include <Fermat.h>
+#include <FermatExpression.h>
+#include <iostream>
+using namespace std;
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        cerr << "usage: " << argv[0] << " <fermat>" << endl;
+        return 2;
+    }
+
+    Fermat fermat(argv[1]);
+
+    fermat.addSymbol("x");
+
+    FermatExpression zero(&fermat,0), seven(&fermat,7);
+    FermatExpression fzero(&fermat,"x-x"), fseven(&fermat,"x-x+7");
+
+    if (!zero.isLocal() || fzero.isLocal()) {
+        cerr << "unexpected representation" << endl;
+        return 1;
+    }
+
+    if (zero.deg("x") != fzero.deg("x") || zero.codeg("x") != fzero.codeg("x")) {
+        cerr << "deg of 0: " << zero.deg("x") << " vs " << fzero.deg("x") << endl;
+        return 1;
+    }
+
+    if (seven.deg("x") != fseven.deg("x") || seven.codeg("x") != fseven.codeg("x")) {
+        cerr << "deg of 7: " << seven.deg("x") << " vs " << fseven.deg("x") << endl;
+        return 1;
+    }
+
+    return 0;
+}
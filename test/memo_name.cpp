@@ -0,0 +1,60 @@
+// vim: set expandtab shiftwidth=4 tabstop=4:
+
+/*
+ *  test/memo_name.cpp
+ *
+ *  Copyright (C) 2017 Mario Prausa
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// an operand changed through name() must not be answered from the memo
+
+#include <Fermat.h>
+#include <FermatExpression.h>
+#include <iostream>
+using namespace std;
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        cerr << "usage: " << argv[0] << " <fermat>" << endl;
+        return 2;
+    }
+
+    Fermat fermat(argv[1]);
+
+    fermat.addSymbol("x");
+    fermat.addSymbol("y");
+    fermat.memoize();
+
+    FermatExpression a(&fermat,"x+y");
+    FermatExpression first = a.subst("x",2);
+    FermatExpression again = a.subst("x",2);
+
+    if (fermat.memoStats().hits != 1) {
+        cerr << "repeated substitution was not memoized" << endl;
+        return 1;
+    }
+
+    fermat(a.name()+":=x*y");
+
+    FermatExpression changed = a.subst("x",2);
+
+    if (first.str() != "y+2" || again.str() != "y+2" || changed.str() != "2*y") {
+        cerr << "stale memo: " << first.str() << ", " << again.str() << ", " << changed.str() << endl;
+        return 1;
+    }
+
+    return 0;
+}
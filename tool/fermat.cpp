@@ -25,6 +25,9 @@
 #include <fstream>
 #include <iomanip>
 #include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include <functional>
 using namespace std;
 
 static vector<string> parseSymbols(const string &str) {
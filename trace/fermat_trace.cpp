@@ -0,0 +1,194 @@
+// vim: set expandtab shiftwidth=4 tabstop=4:
+
+/*
+ *  trace/fermat_trace.cpp
+ *
+ *  Copyright (C) 2017 Mario Prausa
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ *  Summarizes a trace written by Fermat::trace(): time per command kind,
+ *  the commands taking the most time and the distributions of durations
+ *  and response sizes.
+ */
+
+#include <FermatTrace.h>
+#include <FermatStats.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+using namespace std;
+
+struct Total {
+    uint64_t count;
+    uint64_t errors;
+    uint64_t time;
+    uint64_t read;
+};
+
+static const int buckets = 32;
+
+static int bucket(uint64_t v) {
+    int n = 0;
+
+    for (v += 1; v > 1 && n < buckets-1; v >>= 1) ++n;
+    return n;
+}
+
+static void histogram(const string &title, const string &unit, const uint64_t *h) {
+    uint64_t max = *max_element(h,h+buckets);
+    int lo = 0, hi = buckets-1;
+
+    if (!max) return;
+
+    while (!h[lo]) ++lo;
+    while (!h[hi]) --hi;
+
+    cout << endl << title << endl;
+    for (int n=lo; n<=hi; ++n) {
+        uint64_t from = (1ull<<n)-1, to = (2ull<<n)-1;
+
+        cout << right << setw(12) << from << " - " << left << setw(12) << to << unit
+             << right << setw(10) << h[n] << "  " << string((size_t)(50*h[n]/max),'#') << endl;
+    }
+}
+
+static void usage(string progname) {
+    cerr << "Usage: " << progname << " OPTIONS <trace file>" << endl << endl;
+    cerr << left;
+
+    cerr << "OPTIONS:" << endl;
+    cerr << setw(60) << "   --top <n>"                                               << "Number of commands listed. (default: 20)" << endl;
+    cerr << setw(60) << "   --help"                                                  << "this help text." << endl;
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    string filename;
+    size_t top = 20;
+
+    for (int n=1; n<argc; ++n) {
+        string arg = argv[n];
+
+        if (arg == "--top") {
+            if (++n == argc) usage(argv[0]);
+            top = (size_t)atol(argv[n]);
+        } else if (arg.compare(0,2,"--") == 0 || !filename.empty()) {
+            usage(argv[0]);
+        } else {
+            filename = arg;
+        }
+    }
+
+    if (filename.empty()) usage(argv[0]);
+
+    FILE *file = fopen(filename.c_str(),"rb");
+
+    if (!file) {
+        cerr << "cannot open " << filename << endl;
+        return 1;
+    }
+
+    if (!FermatTrace::readHeader(file)) {
+        cerr << filename << " is not a Fermat trace" << endl;
+        fclose(file);
+        return 1;
+    }
+
+    FermatTrace::Record rec;
+    string cmd;
+    Total kinds[FermatStats::NumKinds] = {};
+    Total all = {};
+    map<string,Total> commands;
+    uint64_t durations[buckets] = {}, sizes[buckets] = {};
+    uint64_t first = UINT64_MAX, last = 0;
+
+    while (FermatTrace::read(file,rec,cmd)) {
+        Total *totals[3] = {&all, rec.kind < FermatStats::NumKinds ? &kinds[rec.kind] : &all, &commands[cmd]};
+
+        for (int n=0; n<3; ++n) {
+            if (n == 1 && totals[1] == &all) continue;
+
+            totals[n]->count++;
+            totals[n]->errors += (rec.flags & FermatTrace::Error) ? 1 : 0;
+            totals[n]->time += rec.duration;
+            totals[n]->read += rec.read;
+        }
+
+        durations[bucket(rec.duration)]++;
+        sizes[bucket(rec.read)]++;
+
+        first = min(first,rec.time);
+        last = max<uint64_t>(last,rec.time + 1000ull*rec.duration);
+    }
+
+    fclose(file);
+
+    if (!all.count) {
+        cout << "empty trace" << endl;
+        return 0;
+    }
+
+    cout << fixed << setprecision(3);
+    cout << "commands: " << all.count << ", errors: " << all.errors
+         << ", wall time: " << (last-first)*1e-9 << " s"
+         << ", command time: " << all.time*1e-6 << " s" << endl << endl;
+
+    cout << left << setw(14) << "kind" << right
+         << setw(10) << "count"
+         << setw(10) << "errors"
+         << setw(14) << "time [s]"
+         << setw(10) << "time %"
+         << setw(14) << "bytes/cmd" << endl;
+
+    for (int k=0; k<FermatStats::NumKinds; ++k) {
+        Total &t = kinds[k];
+
+        if (!t.count) continue;
+
+        cout << left << setw(14) << FermatStats::name((FermatStats::Kind)k) << right
+             << setw(10) << t.count
+             << setw(10) << t.errors
+             << setw(14) << setprecision(3) << t.time*1e-6
+             << setw(10) << setprecision(1) << 100.0*t.time/max<uint64_t>(all.time,1)
+             << setw(14) << setprecision(0) << (double)t.read/t.count << endl;
+    }
+
+    vector<pair<string,Total>> sorted(commands.begin(),commands.end());
+    sort(sorted.begin(),sorted.end(),[](const pair<string,Total> &a, const pair<string,Total> &b) {
+        return a.second.time > b.second.time;
+    });
+    if (sorted.size() > top) sorted.resize(top);
+
+    cout << endl << "top commands by time:" << endl;
+    for (auto &c : sorted) {
+        string str = c.first.size() > 60 ? c.first.substr(0,57)+"..." : c.first;
+
+        cout << right << setw(14) << setprecision(3) << c.second.time*1e-6 << " s"
+             << setw(10) << c.second.count << "x  " << str << endl;
+    }
+
+    histogram("durations:"," us",durations);
+    histogram("response sizes:"," bytes",sizes);
+
+    return 0;
+}